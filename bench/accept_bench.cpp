@@ -0,0 +1,150 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Benchmark of the connection establishment rate of a running server (reconnect storm)
+
+   Usage: accept_bench PORT [connections] [threads] [URI]
+
+   All clients connect at once (like after a deploy) and send a request. A connection counts as
+   established, when the first byte of the reply was received (thus the URI must be replied
+   immediately, e.g. a static file; default is "/"). Connections are kept open until all
+   are established, so the server has to hold all of them.
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define SYN_RETRY_TIME   0.9 //connections taking longer most likely had their SYN dropped (initial RTO is 1s)
+#define TIMEOUT          10 //seconds; connections not established (and replied) within count as failed
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static void m_connect(uint16_t port, const string& request, size_t count, vector<int>& sockets, vector<double>& latencies);
+static double m_seconds_since(const chrono::steady_clock::time_point& start);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int main(int argc, const char * argv[])
+{
+   if (argc < 2)
+   {
+      cout << "Usage: accept_bench PORT [connections] [threads] [URI]" << endl;
+      return 1;
+   }
+   const uint16_t port = (uint16_t)strtoul(argv[1], NULL, 10);
+   const size_t connectionCount = (argc > 2) ? strtoul(argv[2], NULL, 10) : 2000;
+   const size_t threadCount = (argc > 3) ? strtoul(argv[3], NULL, 10) : 64;
+   const string uri = (argc > 4) ? argv[4] : "/";
+   const string request = "GET " + uri + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+   vector<vector<int>> sockets(threadCount);
+   vector<vector<double>> latencies(threadCount);
+   vector<thread> threads;
+
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   for (size_t i = 0; i < threadCount; ++i)
+   {
+      const size_t count = (connectionCount / threadCount) + ((i < (connectionCount % threadCount)) ? 1 : 0);
+      threads.push_back(thread(m_connect, port, cref(request), count, ref(sockets[i]), ref(latencies[i])));
+   }
+   for (size_t i = 0; i < threadCount; ++i)
+   {
+      threads[i].join();
+   }
+   const double seconds = m_seconds_since(start);
+
+   //statistics
+   vector<double> all;
+   size_t failed = 0;
+   for (size_t i = 0; i < threadCount; ++i)
+   {
+      all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+      for (size_t k = 0; k < sockets[i].size(); ++k)
+      {
+         if (sockets[i][k] < 0)
+         {
+            failed++;
+         }
+         else
+         {
+            close(sockets[i][k]);
+         }
+      }
+   }
+   sort(all.begin(), all.end());
+   const size_t retried = all.end() - lower_bound(all.begin(), all.end(), SYN_RETRY_TIME);
+
+   cout << all.size() << " of " << connectionCount << " connections established in " << seconds << " s ("
+        << (all.size() / seconds) << " per second), " << failed << " failed" << endl;
+   if (!all.empty())
+   {
+      cout << "latency (ms): median " << (1e3 * all[all.size() / 2]) << ", p99 " << (1e3 * all[(all.size() * 99) / 100])
+           << ", max " << (1e3 * all.back()) << endl;
+      cout << retried << " connections took longer than " << SYN_RETRY_TIME << " s (SYN retransmitted)" << endl;
+   }
+   return (failed == 0) ? 0 : 1;
+}
+
+
+//open count connections, one after the other, and wait for the first byte of each reply
+//the sockets are kept open (-1 for failed connections); the latencies of the established ones are collected
+static void m_connect(uint16_t port, const string& request, size_t count, vector<int>& sockets, vector<double>& latencies)
+{
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(port);
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   struct timeval timeout = { TIMEOUT, 0 };
+
+   for (size_t i = 0; i < count; ++i)
+   {
+      const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      int sock = socket(AF_INET, SOCK_STREAM, 0);
+      char byte;
+      if ((sock < 0) ||
+          (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) || //(also limits connect)
+          (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) ||
+          (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0) ||
+          (send(sock, request.data(), request.length(), MSG_NOSIGNAL) != (ssize_t)request.length()) ||
+          (recv(sock, &byte, 1, 0) != 1))
+      {
+         if (sock >= 0)
+         {
+            close(sock);
+         }
+         sockets.push_back(-1);
+         continue;
+      }
+      latencies.push_back(m_seconds_since(start));
+      sockets.push_back(sock);
+   }
+}
+
+
+static double m_seconds_since(const chrono::steady_clock::time_point& start)
+{
+   return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,94 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Benchmark of xcrc32: throughput of the byte-wise, slice-by-8 and PCLMULQDQ paths
+
+   Usage: crc32_bench [megabytes]
+*/
+//-----------------------------------------------------------------------------
+
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../crc32.c" //(the paths are module global)
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+typedef unsigned int (*crc32_t)(const unsigned char *, size_t, unsigned int);
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Module Global Variables --------------------------------------------- */
+//sizes of the published contents
+static const size_t sizes[] = { 64, 1024, 64 * 1024, 4 * 1024 * 1024 };
+#define SIZE_COUNT   (sizeof(sizes) / sizeof(sizes[0]))
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static void run(const char * name, crc32_t crc, const unsigned char * data, size_t total);
+static double now(void);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int main(int argc, const char * argv[])
+{
+   const size_t total = ((argc > 1) ? strtoul(argv[1], NULL, 10) : 256) * 1024 * 1024; //bytes processed per path and size
+   unsigned char * data = (unsigned char *)malloc(sizes[SIZE_COUNT - 1]);
+
+   if (data == NULL)
+   {
+      return 1;
+   }
+   memset(data, 0x5A, sizes[SIZE_COUNT - 1]);
+
+   printf("%-12s", "bytes");
+   for (size_t i = 0; i < SIZE_COUNT; ++i)
+   {
+      printf("%10u", (unsigned)sizes[i]);
+   }
+   printf("   (GB/s)\n");
+
+   run("byte-wise", crc32_bytewise, data, total / 8); //(slow)
+   run("slice-by-8", crc32_sliced, data, total);
+#ifdef CRC32_CLMUL_X86
+   if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+   {
+      run("PCLMULQDQ", crc32_clmul, data, total);
+   }
+#endif
+   free(data);
+   return 0;
+}
+
+
+//print the throughput of the path for each size, processing about total bytes each
+static void run(const char * name, crc32_t crc, const unsigned char * data, size_t total)
+{
+   unsigned int sink = 0;
+
+   printf("%-12s", name);
+   for (size_t i = 0; i < SIZE_COUNT; ++i)
+   {
+      const size_t count = (total / sizes[i]) + 1;
+      const double start = now();
+      for (size_t n = 0; n < count; ++n)
+      {
+         sink ^= crc(data, sizes[i], 0xFFFFFFFFu);
+      }
+      const double seconds = now() - start;
+      printf("%10.2f", (double)count * sizes[i] / seconds / 1e9);
+   }
+   printf("   (%08x)\n", sink);
+}
+
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (1e-9 * (double)ts.tv_nsec);
+}
@@ -0,0 +1,249 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Benchmark of the header scanning of hqsp: byte-wise loops (as used before) vs. scalar, SSE2 and AVX2 kernels
+
+   Usage: hqsp_bench [iterations]
+*/
+//-----------------------------------------------------------------------------
+
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "../hqsp.c" //(the kernels are module global)
+
+/* -- Defines ------------------------------------------------------------- */
+#define LOOKUPS   4 //header fields looked up per request (as by the server)
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Module Global Variables --------------------------------------------- */
+//requests, as sent by browsers, long polling clients and publishers
+static const char * corpus[] =
+{
+   "GET /index.html HTTP/1.1\r\n"
+   "Host: sensors.example.com\r\n"
+   "Connection: keep-alive\r\n"
+   "Cache-Control: max-age=0\r\n"
+   "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+   "sec-ch-ua-mobile: ?0\r\n"
+   "sec-ch-ua-platform: \"Linux\"\r\n"
+   "Upgrade-Insecure-Requests: 1\r\n"
+   "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+   "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+   "Sec-Fetch-Site: none\r\n"
+   "Sec-Fetch-Mode: navigate\r\n"
+   "Sec-Fetch-User: ?1\r\n"
+   "Sec-Fetch-Dest: document\r\n"
+   "Accept-Encoding: gzip, deflate, br\r\n"
+   "Accept-Language: de-DE,de;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+   "If-None-Match: \"5f3a-1c2b\"\r\n"
+   "\r\n",
+
+   "GET /api/sensors/17/temperature HTTP/1.1\r\n"
+   "Host: sensors.example.com\r\n"
+   "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0\r\n"
+   "Accept: */*\r\n"
+   "Accept-Language: en-US,en;q=0.5\r\n"
+   "Accept-Encoding: gzip, deflate, br\r\n"
+   "Referer: http://sensors.example.com/index.html\r\n"
+   "Content-Hash: 2881632474\r\n"
+   "Connection: keep-alive\r\n"
+   "\r\n",
+
+   "POST /api/sensors/17/temperature HTTP/1.1\r\n"
+   "Host: sensors.example.com\r\n"
+   "User-Agent: python-requests/2.31.0\r\n"
+   "Accept-Encoding: gzip, deflate\r\n"
+   "Accept: */*\r\n"
+   "Connection: keep-alive\r\n"
+   "Content-Type: application/json\r\n"
+   "Content-Length: 164\r\n"
+   "\r\n"
+   "{\"sensor\":17,\"unit\":\"C\",\"value\":21.5,\"min\":18.25,\"max\":23.75,\"timestamp\":\"2023-10-17T12:00:00Z\","
+   "\"location\":\"lab 2\",\"status\":\"ok\",\"samples\":60,\"battery\":97}",
+
+   "GET /api/sensors/3/humidity HTTP/1.1\r\n"
+   "Host: localhost:8080\r\n"
+   "User-Agent: curl/8.4.0\r\n"
+   "Accept: */*\r\n"
+   "\r\n",
+};
+#define CORPUS_SIZE   (sizeof(corpus) / sizeof(corpus[0]))
+
+static unsigned lengths[CORPUS_SIZE];
+static const char * lookups[LOOKUPS] = { "Content-Length", "Content-Hash", "Connection", "Accept-Encoding" };
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static int old_get_header_value(const char * request, const char * header, const char ** x);
+static int old_get_post_content(const char * request, const unsigned requestLen, const char ** x);
+static double run(int old, unsigned iterations, unsigned long * sum);
+static void report(const char * name, double seconds, unsigned iterations, size_t bytes);
+static double now(void);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int main(int argc, const char * argv[])
+{
+   const unsigned iterations = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 10) : 200000;
+   const find_byte_t selectedFindByte = find_byte;
+   const find_end_of_header_t selectedFindEndOfHeader = find_end_of_header;
+   unsigned long expected; //sum of the lengths found by the byte-wise loops
+   unsigned long sum;
+   int mismatches = 0;
+   size_t bytes = 0;
+   unsigned i;
+
+   for (i = 0; i < CORPUS_SIZE; ++i)
+   {
+      lengths[i] = (unsigned)strlen(corpus[i]);
+      bytes += lengths[i];
+   }
+   printf("%u requests (%u bytes), %d header lookups and post content each\n", (unsigned)CORPUS_SIZE, (unsigned)bytes, LOOKUPS);
+
+   report("byte-wise", run(1, iterations, &expected), iterations, bytes);
+
+   find_byte = find_byte_scalar;
+   find_end_of_header = find_end_of_header_scalar;
+   report("scalar", run(0, iterations, &sum), iterations, bytes);
+   mismatches += (sum != expected);
+#ifdef HQSP_SIMD_X86
+   if (__builtin_cpu_supports("sse2"))
+   {
+      find_byte = find_byte_sse2;
+      find_end_of_header = find_end_of_header_sse2;
+      report("sse2", run(0, iterations, &sum), iterations, bytes);
+      mismatches += (sum != expected);
+   }
+   if (__builtin_cpu_supports("avx2"))
+   {
+      find_byte = find_byte_avx2;
+      find_end_of_header = find_end_of_header_avx2;
+      report("avx2", run(0, iterations, &sum), iterations, bytes);
+      mismatches += (sum != expected);
+   }
+#endif
+   find_byte = selectedFindByte;
+   find_end_of_header = selectedFindEndOfHeader;
+
+   //all variants must find the same values
+   if (mismatches > 0)
+   {
+      printf("results differ from the byte-wise loops\n");
+      return 1;
+   }
+   return 0;
+}
+
+
+//look up the header fields and the post content of all requests of the corpus, iterations times
+//returns the time taken in seconds; the lengths found are summed up into sum
+static double run(int old, unsigned iterations, unsigned long * sum)
+{
+   unsigned long total = 0;
+   const char * x;
+   unsigned i, k, n;
+
+   const double start = now();
+   for (n = 0; n < iterations; ++n)
+   {
+      for (i = 0; i < CORPUS_SIZE; ++i)
+      {
+         const char * request = corpus[i];
+         for (k = 0; k < LOOKUPS; ++k)
+         {
+            total += (unsigned long)(old ? old_get_header_value(request, lookups[k], &x) : hqsp_get_header_value(request, lengths[i], lookups[k], &x));
+         }
+         total += (unsigned long)(old ? old_get_post_content(request, lengths[i], &x) : hqsp_get_post_content(request, lengths[i], &x));
+      }
+   }
+   const double seconds = now() - start;
+   *sum = total;
+   return seconds;
+}
+
+
+static void report(const char * name, double seconds, unsigned iterations, size_t bytes)
+{
+   printf("%-10s %7.1f ns/request, %6.0f MB/s\n", name, 1e9 * seconds / ((double)iterations * CORPUS_SIZE),
+          (double)bytes * iterations / seconds / 1e6);
+}
+
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (1e-9 * (double)ts.tv_nsec);
+}
+
+
+//the byte-wise loops, hqsp used before the kernels were introduced
+static int old_get_header_value(const char * request, const char * header, const char ** x)
+{
+   const int headerLen = strlen(header);
+   const char * iterator;
+   const char * start;
+   const char * end;
+   int matchLen;
+   int len;
+
+   start = NULL;
+   matchLen = 0;
+   uint32_t shiftReg = 0;
+   const uint32_t endOfHeader = ((uint32_t)'\r' << 24) | ((uint32_t)'\n' << 16) | ((uint32_t)'\r' << 8) | (uint32_t)'\n';
+   for (iterator = request; shiftReg != endOfHeader; ++iterator)
+   {
+      if (*iterator == 0) return 0;
+      shiftReg = (shiftReg  << 8) | (uint8_t)*iterator;
+
+      if (*iterator == header[matchLen])
+      {
+         ++matchLen;
+         if (matchLen == headerLen)
+         {
+            if ((iterator[1] == ':') && (iterator[2] == ' '))
+            {
+               start = &iterator[3];
+               break;
+            }
+            matchLen = 0;
+         }
+         continue;
+      }
+      matchLen = 0;
+   }
+
+   if (start != NULL)
+   {
+      *x = start;
+      for (end = start, len = 0; *end != '\r'; ++end, ++len);
+      return len;
+   }
+   return 0;
+}
+
+
+static int old_get_post_content(const char * request, const unsigned requestLen, const char ** x)
+{
+   const char * start;
+   unsigned len;
+
+   uint32_t shiftReg = 0;
+   const uint32_t endOfHeader = ((uint32_t)'\r' << 24) | ((uint32_t)'\n' << 16) | ((uint32_t)'\r' << 8) | (uint32_t)'\n';
+   for (start = request, len = 0; shiftReg != endOfHeader; ++start, ++len)
+   {
+      if (*start == 0)
+      {
+         return 0;
+      }
+      shiftReg = (shiftReg  << 8) | (uint8_t)*start;
+   }
+   *x = start;
+   return (requestLen - len);
+}
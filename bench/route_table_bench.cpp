@@ -0,0 +1,107 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Benchmark of the route table, compared to the linear search of a list of resources (as used before)
+
+   Usage: route_table_bench [resources] [lookups]
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <iostream>
+#include <string>
+#include <list>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdlib.h>
+#include "dynamic_resource.h"
+#include "route_table.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static double m_seconds_since(const chrono::steady_clock::time_point& start);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int main(int argc, const char * argv[])
+{
+   const size_t resourceCount = (argc > 1) ? strtoul(argv[1], NULL, 10) : 5000;
+   const size_t lookupCount = (argc > 2) ? strtoul(argv[2], NULL, 10) : 100000;
+   list<DynamicResource *> dynamicResources;
+   RouteTable routes;
+
+   //resources, as listed in dynres.txt
+   for (size_t i = 0; i < resourceCount; ++i)
+   {
+      DynamicResource * res = new DynamicResource("/api/sensors/" + to_string(i) + "/temperature");
+      dynamicResources.push_back(res);
+      routes.insert(res);
+   }
+
+   //requested URIs (existing ones, in random order), as "string-pointer" and length into a request buffer
+   string requests;
+   vector<size_t> offsets;
+   mt19937 random(42);
+   for (size_t i = 0; i < lookupCount; ++i)
+   {
+      offsets.push_back(requests.length());
+      requests += "/api/sensors/" + to_string(random() % resourceCount) + "/temperature";
+   }
+   offsets.push_back(requests.length());
+
+   //linear search, comparing std::strings
+   size_t found = 0;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   for (size_t i = 0; i < lookupCount; ++i)
+   {
+      string uri(&requests[offsets[i]], offsets[i + 1] - offsets[i]);
+      for (list<DynamicResource *>::iterator resIt = dynamicResources.begin(); resIt != dynamicResources.end(); ++resIt)
+      {
+         if ((*resIt)->uri == uri)
+         {
+            found++;
+            break;
+         }
+      }
+   }
+   const double listTime = m_seconds_since(start);
+
+   //hashed route table, without building a std::string
+   start = chrono::steady_clock::now();
+   for (size_t i = 0; i < lookupCount; ++i)
+   {
+      if (routes.find(&requests[offsets[i]], offsets[i + 1] - offsets[i]) != NULL)
+      {
+         found++;
+      }
+   }
+   const double tableTime = m_seconds_since(start);
+
+   cout << resourceCount << " resources, " << lookupCount << " lookups (" << found << " found)" << endl;
+   cout << "list:  " << (1e9 * listTime / lookupCount) << " ns/lookup" << endl;
+   cout << "table: " << (1e9 * tableTime / lookupCount) << " ns/lookup" << endl;
+   cout << "speedup: " << (listTime / tableTime) << endl;
+
+   for (list<DynamicResource *>::iterator resIt = dynamicResources.begin(); resIt != dynamicResources.end(); ++resIt)
+   {
+      delete *resIt;
+   }
+   return ((found == (2 * lookupCount)) ? 0 : 1);
+}
+
+
+static double m_seconds_since(const chrono::steady_clock::time_point& start)
+{
+   return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,167 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Content codings (gzip, brotli) of replies
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#include "compression.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define GZIP_LEVEL       6 //zlib default (compression is done once per content, but while publishing it)
+#define BROTLI_QUALITY   5 //about as fast as gzip, but denser (the max. quality of 11 is too slow to publish large content)
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+static const char * const m_names[Compression::ENCODINGS] = { "br", "gzip" };
+static const char * const m_suffixes[Compression::ENCODINGS] = { ".br", ".gz" };
+
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static bool m_compress_gzip(const string& data, string& compressed);
+static bool m_compress_brotli(const string& data, string& compressed);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+unsigned Compression::parseAcceptEncoding(const char * value, int valueLen)
+{
+   unsigned accepted = 0;
+   int pos = 0;
+
+   //list of "coding[;q=weight]", separated by ','
+   while (pos < valueLen)
+   {
+      //coding
+      while ((pos < valueLen) && ((value[pos] == ' ') || (value[pos] == ',')))
+      {
+         ++pos;
+      }
+      const int start = pos;
+      while ((pos < valueLen) && (value[pos] != ',') && (value[pos] != ';') && (value[pos] != ' '))
+      {
+         ++pos;
+      }
+      const int len = pos - start;
+
+      //weight (only "q=0" matters)
+      bool excluded = false;
+      while ((pos < valueLen) && (value[pos] != ','))
+      {
+         if ((value[pos] == '=') && ((pos + 1) < valueLen))
+         {
+            excluded = (strtod(&value[pos + 1], NULL) <= 0.0);
+         }
+         ++pos;
+      }
+      if (excluded || (len == 0))
+      {
+         continue;
+      }
+
+      if ((len == 1) && (value[start] == '*'))
+      {
+         accepted |= (1u << ENCODINGS) - 1;
+         continue;
+      }
+      for (int i = 0; i < ENCODINGS; ++i)
+      {
+         if ((len == (int)strlen(m_names[i])) && (strncasecmp(&value[start], m_names[i], len) == 0))
+         {
+            accepted |= (1u << i);
+         }
+      }
+   }
+   return accepted;
+}
+
+
+const char * Compression::getName(Encoding encoding)
+{
+   return m_names[encoding];
+}
+
+
+const char * Compression::getSuffix(Encoding encoding)
+{
+   return m_suffixes[encoding];
+}
+
+
+bool Compression::compress(Encoding encoding, const string& data, string& compressed)
+{
+   compressed.clear();
+   if (encoding == GZIP)
+   {
+      return m_compress_gzip(data, compressed);
+   }
+   if (encoding == BROTLI)
+   {
+      return m_compress_brotli(data, compressed);
+   }
+   return false;
+}
+
+
+static bool m_compress_gzip(const string& data, string& compressed)
+{
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) //+16: gzip wrapper
+   {
+      return false;
+   }
+   compressed.resize(deflateBound(&stream, data.length()));
+   stream.next_in = (Bytef *)data.data();
+   stream.avail_in = (uInt)data.length();
+   stream.next_out = (Bytef *)&compressed[0];
+   stream.avail_out = (uInt)compressed.length();
+   const int status = deflate(&stream, Z_FINISH);
+   deflateEnd(&stream);
+   if (status != Z_STREAM_END) //(the output is incomplete)
+   {
+      compressed.clear();
+      return false;
+   }
+   compressed.resize(stream.total_out);
+   return true;
+}
+
+
+static bool m_compress_brotli(const string& data, string& compressed)
+{
+#ifdef HAVE_BROTLI
+   size_t len = BrotliEncoderMaxCompressedSize(data.length());
+   if (len == 0)
+   {
+      return false;
+   }
+   compressed.resize(len);
+   if (!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, data.length(),
+                              (const uint8_t *)data.data(), &len, (uint8_t *)&compressed[0]))
+   {
+      compressed.clear();
+      return false;
+   }
+   compressed.resize(len);
+   return true;
+#else
+   (void)data;
+   (void)compressed;
+   return false;
+#endif
+}
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Content codings (gzip, brotli) of replies
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef COMPRESSION_H_INCLUDED
+#define COMPRESSION_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+class Compression
+{
+public:
+   //content codings, in order of preference
+   enum Encoding
+   {
+      BROTLI,
+      GZIP,
+      ENCODINGS, //number of content codings
+   };
+
+   //bitmask of the content codings (1 << Encoding) accepted by a client, given the value of "Accept-Encoding"
+   //codings with "q=0" are not accepted; "*" accepts all of them
+   static unsigned parseAcceptEncoding(const char * value, int valueLen);
+
+   //name of the coding ("Content-Encoding"), and the suffix of precompressed files
+   static const char * getName(Encoding encoding);
+   static const char * getSuffix(Encoding encoding);
+
+   //compress data (brotli is only available, if the server was built with it)
+   //returns false in case of errors (compressed is empty then)
+   static bool compress(Encoding encoding, const std::string& data, std::string& compressed);
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // COMPRESSION_H_INCLUDED
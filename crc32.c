@@ -61,6 +61,13 @@
    For more information on CRC, see, e.g.,
    http://www.ross.net/crc/download/crc_v3.txt.  */
 
+#include <stddef.h>
+#include <stdint.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CRC32_CLMUL_X86 /* PCLMULQDQ folding, selected at runtime */
+#include <immintrin.h>
+#endif
+
 static const unsigned int crc32_table[] =
 {
   0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9,
@@ -160,8 +167,30 @@ make it easy to compose the values of multiple blocks.
 
 */
 
+/* Tables for slice-by-8: crc32_slice[k][b] is the CRC of byte b followed
+   by k zero bytes.  crc32_slice[0] equals crc32_table.  Filled by
+   crc32_init.  */
+static unsigned int crc32_slice[8][256];
+
+/* Folding constants x^n mod P (see crc32_init).  */
+static uint64_t crc32_x128, crc32_x192, crc32_x512, crc32_x576;
+
+/* Implementation in use; the table based loop (which needs no
+   initialization) until crc32_init has run.  */
+static unsigned int crc32_bytewise (const unsigned char *, size_t, unsigned int);
+static unsigned int (*crc32_impl) (const unsigned char *, size_t, unsigned int)
+  = crc32_bytewise;
+
 unsigned int
 xcrc32 (const unsigned char *buf, int len, unsigned int init)
+{
+  return crc32_impl (buf, len > 0 ? (size_t) len : 0, init);
+}
+
+/* The original byte at a time loop.  */
+
+static unsigned int
+crc32_bytewise (const unsigned char *buf, size_t len, unsigned int init)
 {
   unsigned int crc = init;
   while (len--)
@@ -171,3 +200,146 @@ xcrc32 (const unsigned char *buf, int len, unsigned int init)
     }
   return crc;
 }
+
+/* Slice-by-8: process 8 bytes per step, using 8 table lookups that are
+   independent of each other.  As the CRC is not reflected, the first 4
+   bytes of each step are combined with the CRC in big-endian order.  */
+
+static unsigned int
+crc32_sliced (const unsigned char *buf, size_t len, unsigned int init)
+{
+  unsigned int crc = init;
+  while (len >= 8)
+    {
+      unsigned int x = crc ^ (((unsigned int) buf[0] << 24)
+			      | ((unsigned int) buf[1] << 16)
+			      | ((unsigned int) buf[2] << 8)
+			      | (unsigned int) buf[3]);
+      crc = crc32_slice[7][x >> 24]
+	    ^ crc32_slice[6][(x >> 16) & 255]
+	    ^ crc32_slice[5][(x >> 8) & 255]
+	    ^ crc32_slice[4][x & 255]
+	    ^ crc32_slice[3][buf[4]]
+	    ^ crc32_slice[2][buf[5]]
+	    ^ crc32_slice[1][buf[6]]
+	    ^ crc32_slice[0][buf[7]];
+      buf += 8;
+      len -= 8;
+    }
+  return crc32_bytewise (buf, len, crc);
+}
+
+#ifdef CRC32_CLMUL_X86
+
+/* Carry-less multiplication (PCLMULQDQ) folding, following Intel's
+   "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+   Instruction".  Blocks of 16 bytes are loaded byte-reversed, so bit 127
+   of a register is the first bit of the block.  A 128-bit remainder
+   H*x^64 + L is advanced over n bits by H*(x^(n+64) mod P) + L*(x^n mod P),
+   which is congruent modulo P and fits into 128 bits again.  Four
+   remainders are folded in parallel over 64 bytes per step.  The final
+   remainder and the remaining bytes are reduced by the sliced path.  */
+
+__attribute__((target ("pclmul,ssse3")))
+static __m128i
+crc32_fold (__m128i x, __m128i k)
+{
+  return _mm_xor_si128 (_mm_clmulepi64_si128 (x, k, 0x11),
+			_mm_clmulepi64_si128 (x, k, 0x00));
+}
+
+__attribute__((target ("pclmul,ssse3")))
+static unsigned int
+crc32_clmul (const unsigned char *buf, size_t len, unsigned int init)
+{
+  const __m128i reverse = _mm_set_epi8 (0, 1, 2, 3, 4, 5, 6, 7,
+					8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i k128 = _mm_set_epi64x ((long long) crc32_x192,
+				       (long long) crc32_x128);
+  const __m128i k512 = _mm_set_epi64x ((long long) crc32_x576,
+				       (long long) crc32_x512);
+  __m128i x0, x1, x2, x3;
+  unsigned char rest[16];
+
+  if (len < 128)
+    return crc32_sliced (buf, len, init);
+
+  /* The initial value is added to the first 32 bits of the message.  */
+#define CRC32_LOAD(p) \
+  _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (p)), reverse)
+  x0 = _mm_xor_si128 (CRC32_LOAD (buf), _mm_set_epi32 ((int) init, 0, 0, 0));
+  x1 = CRC32_LOAD (buf + 16);
+  x2 = CRC32_LOAD (buf + 32);
+  x3 = CRC32_LOAD (buf + 48);
+  buf += 64;
+  len -= 64;
+
+  while (len >= 64)
+    {
+      x0 = _mm_xor_si128 (crc32_fold (x0, k512), CRC32_LOAD (buf));
+      x1 = _mm_xor_si128 (crc32_fold (x1, k512), CRC32_LOAD (buf + 16));
+      x2 = _mm_xor_si128 (crc32_fold (x2, k512), CRC32_LOAD (buf + 32));
+      x3 = _mm_xor_si128 (crc32_fold (x3, k512), CRC32_LOAD (buf + 48));
+      buf += 64;
+      len -= 64;
+    }
+
+  /* Combine the four remainders, then continue with 16 bytes per step.  */
+  x1 = _mm_xor_si128 (crc32_fold (x0, k128), x1);
+  x2 = _mm_xor_si128 (crc32_fold (x1, k128), x2);
+  x3 = _mm_xor_si128 (crc32_fold (x2, k128), x3);
+  while (len >= 16)
+    {
+      x3 = _mm_xor_si128 (crc32_fold (x3, k128), CRC32_LOAD (buf));
+      buf += 16;
+      len -= 16;
+    }
+#undef CRC32_LOAD
+
+  /* The CRC of the remainder (as a 16 byte message, initial value 0) is
+     the CRC of everything up to here.  */
+  _mm_storeu_si128 ((__m128i *) rest, _mm_shuffle_epi8 (x3, reverse));
+  return crc32_sliced (buf, len, crc32_sliced (rest, 16, 0));
+}
+
+#endif /* CRC32_CLMUL_X86 */
+
+/* x^n mod P, as 32-bit polynomial (x^32 being implicit in P).  */
+
+static uint64_t
+crc32_xpow (unsigned int n)
+{
+  unsigned int r = 1;
+  while (n--)
+    r = r & 0x80000000 ? (r << 1) ^ 0x04c11db7 : (r << 1);
+  return r;
+}
+
+/* Fill the tables and select the fastest implementation supported by
+   the CPU (once, at program start).  */
+
+__attribute__((constructor))
+static void
+crc32_init (void)
+{
+  unsigned int i, k;
+
+  for (i = 0; i < 256; i++)
+    {
+      crc32_slice[0][i] = crc32_table[i];
+      for (k = 1; k < 8; k++)
+	crc32_slice[k][i] = (crc32_slice[k - 1][i] << 8)
+			    ^ crc32_table[crc32_slice[k - 1][i] >> 24];
+    }
+  crc32_x128 = crc32_xpow (128);
+  crc32_x192 = crc32_xpow (192);
+  crc32_x512 = crc32_xpow (512);
+  crc32_x576 = crc32_xpow (576);
+
+  crc32_impl = crc32_sliced;
+#ifdef CRC32_CLMUL_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("pclmul") && __builtin_cpu_supports ("ssse3"))
+    crc32_impl = crc32_clmul;
+#endif
+}
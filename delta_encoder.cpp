@@ -0,0 +1,163 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Binary delta (copy/insert instructions) between two versions of a dynamic resource
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include <vector>
+#include "delta_encoder.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define BLOCK_SIZE   16 //size of the blocks of the base, that are indexed (min. length of a copy instruction)
+#define PRIME        16777619u //multiplier of the rolling hash
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static uint32_t m_hash_block(const uint8_t * data);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+void DeltaEncoder::encode(const string& base, const string& target, string& delta)
+{
+   const uint8_t * b = (const uint8_t *)base.data();
+   const uint8_t * t = (const uint8_t *)target.data();
+   const size_t baseLen = base.length();
+   const size_t targetLen = target.length();
+   const size_t minLen = (baseLen < targetLen) ? baseLen : targetLen;
+
+   delta.clear();
+
+   //usually only a few parts change -> copy common prefix and suffix directly
+   size_t prefix = 0;
+   while ((prefix < minLen) && (b[prefix] == t[prefix]))
+   {
+      ++prefix;
+   }
+   size_t suffix = 0;
+   while (((prefix + suffix) < minLen) && (b[baseLen - 1 - suffix] == t[targetLen - 1 - suffix]))
+   {
+      ++suffix;
+   }
+   if (prefix > 0)
+   {
+      appendCopy(delta, 0, prefix);
+   }
+
+   //index the blocks of the base (positions are stored +1; 0 marks an empty slot)
+   const size_t end = targetLen - suffix; //end of the part of the target to be encoded
+   size_t capacity = 64;
+   while (capacity < ((baseLen / BLOCK_SIZE) * 2))
+   {
+      capacity *= 2;
+   }
+   vector<uint32_t> index(capacity, 0);
+   for (size_t pos = 0; (pos + BLOCK_SIZE) <= baseLen; pos += BLOCK_SIZE)
+   {
+      index[m_hash_block(&b[pos]) & (capacity - 1)] = (uint32_t)(pos + 1);
+   }
+
+   //find blocks of the base within the rest of the target (rolling hash)
+   uint32_t power = 1; //PRIME^(BLOCK_SIZE-1), to remove the leading byte from the hash
+   for (int i = 1; i < BLOCK_SIZE; ++i)
+   {
+      power *= PRIME;
+   }
+   size_t literal = prefix; //start of data not yet encoded
+   size_t i = prefix;
+   uint32_t hash = ((i + BLOCK_SIZE) <= end) ? m_hash_block(&t[i]) : 0;
+   while ((i + BLOCK_SIZE) <= end)
+   {
+      const uint32_t candidate = index[hash & (capacity - 1)];
+      if ((candidate != 0) && (memcmp(&b[candidate - 1], &t[i], BLOCK_SIZE) == 0))
+      {
+         size_t pos = candidate - 1;
+         size_t len = BLOCK_SIZE;
+         //extend match, backwards into the pending literal and forwards
+         while ((i > literal) && (pos > 0) && (b[pos - 1] == t[i - 1]))
+         {
+            --i;
+            --pos;
+            ++len;
+         }
+         while (((i + len) < end) && ((pos + len) < baseLen) && (b[pos + len] == t[i + len]))
+         {
+            ++len;
+         }
+         appendInsert(delta, &t[literal], i - literal);
+         appendCopy(delta, pos, len);
+         i += len;
+         literal = i;
+         if ((i + BLOCK_SIZE) <= end)
+         {
+            hash = m_hash_block(&t[i]);
+         }
+         continue;
+      }
+      //no match -> roll the hash by one byte
+      if ((i + BLOCK_SIZE) < end)
+      {
+         hash = ((hash - (t[i] * power)) * PRIME) + t[i + BLOCK_SIZE];
+      }
+      ++i;
+   }
+   appendInsert(delta, &t[literal], end - literal);
+
+   if (suffix > 0)
+   {
+      appendCopy(delta, baseLen - suffix, suffix);
+   }
+}
+
+
+void DeltaEncoder::appendCopy(string& delta, size_t offset, size_t length)
+{
+   delta.push_back((char)COPY);
+   appendNumber(delta, offset);
+   appendNumber(delta, length);
+}
+
+
+void DeltaEncoder::appendInsert(string& delta, const uint8_t * data, size_t length)
+{
+   if (length > 0)
+   {
+      delta.push_back((char)INSERT);
+      appendNumber(delta, length);
+      delta.append((const char *)data, length);
+   }
+}
+
+
+void DeltaEncoder::appendNumber(string& delta, size_t value)
+{
+   while (value >= 0x80)
+   {
+      delta.push_back((char)(0x80 | (value & 0x7F)));
+      value >>= 7;
+   }
+   delta.push_back((char)value);
+}
+
+
+//polynomial hash of a block (same as the rolling hash, computed from scratch)
+static uint32_t m_hash_block(const uint8_t * data)
+{
+   uint32_t hash = 0;
+   for (int i = 0; i < BLOCK_SIZE; ++i)
+   {
+      hash = (hash * PRIME) + data[i];
+   }
+   return hash;
+}
@@ -0,0 +1,51 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Binary delta (copy/insert instructions) between two versions of a dynamic resource
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef DELTA_ENCODER_H_INCLUDED
+#define DELTA_ENCODER_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+//encodes a target as sequence of instructions, referencing a base:
+//   COPY   (0x01) offset length : append length bytes of the base, starting at offset
+//   INSERT (0x02) length bytes  : append the given bytes
+//numbers are encoded as unsigned LEB128 (7 bits per byte, least significant first)
+class DeltaEncoder
+{
+public:
+   enum
+   {
+      COPY = 0x01,
+      INSERT = 0x02,
+   };
+
+   //encode target against base (matching blocks are found by a rolling hash, in linear time)
+   static void encode(const std::string& base, const std::string& target, std::string& delta);
+
+private:
+   static void appendCopy(std::string& delta, size_t offset, size_t length);
+   static void appendInsert(std::string& delta, const uint8_t * data, size_t length);
+   static void appendNumber(std::string& delta, size_t value);
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // DELTA_ENCODER_H_INCLUDED
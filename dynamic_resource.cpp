@@ -7,7 +7,12 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <string>
+#include <time.h>
 #include "dynamic_resource.h"
+#include "delta_encoder.h"
+#include "websocket.h"
+#include "event_loop.h"
+#include "snapshot_store.h"
 
 
 /* -- Defines ------------------------------------------------------------- */
@@ -18,6 +23,13 @@ using namespace std;
 /* -- Types --------------------------------------------------------------- */
 
 /* -- (Module) Global Variables ------------------------------------------- */
+vector<ReplyQueue *> DynamicResource::replyQueues;
+DynamicResource::HashMode DynamicResource::hashMode = DynamicResource::HASH_CRC32;
+uint64_t DynamicResource::initialVersion = 1;
+size_t DynamicResource::historyDepth = 0;
+size_t DynamicResource::historyBudget = 0;
+string DynamicResource::boundary;
+size_t DynamicResource::compressMinSize = 0;
 
 /* -- Module Global Function Prototypes ----------------------------------- */
 extern "C" unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
@@ -25,28 +37,616 @@ extern "C" unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int
 
 /* -- Implementation ------------------------------------------------------ */
 
+WaiterList::WaiterList()
+{
+   this->head.prev = &this->head;
+   this->head.next = &this->head;
+   this->head.context = NULL;
+}
+
+
+bool WaiterList::isEmpty() const
+{
+   return (this->head.next == &this->head);
+}
+
+
+void WaiterList::push(Waiter * waiter)
+{
+   waiter->prev = this->head.prev;
+   waiter->next = &this->head;
+   this->head.prev->next = waiter;
+   this->head.prev = waiter;
+}
+
+
+Waiter * WaiterList::front() const
+{
+   Waiter * waiter = this->head.next;
+   return (waiter != &this->head) ? waiter : NULL;
+}
+
+
+Waiter * WaiterList::pop()
+{
+   Waiter * waiter = this->head.next;
+   if (waiter == &this->head)
+   {
+      return NULL;
+   }
+   unlink(waiter);
+   return waiter;
+}
+
+
+void WaiterList::splice(WaiterList& other)
+{
+   if (other.isEmpty())
+   {
+      return;
+   }
+   Waiter * first = other.head.next;
+   Waiter * last = other.head.prev;
+   //link chain to the end of this list
+   first->prev = this->head.prev;
+   last->next = &this->head;
+   this->head.prev->next = first;
+   this->head.prev = last;
+   //other list becomes empty
+   other.head.next = &other.head;
+   other.head.prev = &other.head;
+}
+
+
+void WaiterList::unlink(Waiter * waiter)
+{
+   if (waiter->next != NULL)
+   {
+      waiter->prev->next = waiter->next;
+      waiter->next->prev = waiter->prev;
+      waiter->prev = NULL;
+      waiter->next = NULL;
+   }
+}
+
+
+void WaiterList::init(Waiter * waiter, void * context)
+{
+   waiter->prev = NULL;
+   waiter->next = NULL;
+   waiter->context = context;
+}
+
+
+bool WaiterList::isLinked(const Waiter * waiter)
+{
+   return (waiter->next != NULL);
+}
+
+
+
+
+ReplyQueue::ReplyQueue(EventLoop * eventLoop)
+{
+   this->id = 0;
+   this->eventLoop = eventLoop;
+}
+
+
+void ReplyQueue::takeAll(WaiterList& list)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   list.splice(this->waiters);
+}
+
+
+
+
 DynamicResource::DynamicResource(const string& uri, const string& statusCode)
 {
    this->uri = uri;
-   this->content = "";
    this->contentType = "text/plain";
    this->statusCode = statusCode;
-   this->hash = 1; //this prevents an immediate load empty resources
+   this->hash = (hashMode == HASH_VERSION) ? initialVersion : 1; //this prevents an immediate load empty resources
+   this->rendered = this->render("");
+   this->historySize = 0;
+   if (historyDepth > 0)
+   {
+      this->history.push_back(this->rendered);
+   }
+   this->waiters = new WaiterList[replyQueues.size() + 1]; //+1: avoid zero sized array
+   this->snapshot = NULL;
+   this->retired = false;
+}
+
+
+DynamicResource::~DynamicResource()
+{
+   delete[] this->waiters;
 }
 
 
 void  DynamicResource::setContentType(const std::string& contentType)
 {
-   this->contentType = contentType;
+   lock_guard<std::mutex> lock(this->mutex);
+   if (this->contentType != contentType) //re-render, only if the header changes
+   {
+      this->contentType = contentType;
+      string compressed[Compression::ENCODINGS];
+      for (int i = 0; i < Compression::ENCODINGS; ++i)
+      {
+         if (this->rendered->encoded[i])
+         {
+            compressed[i] = this->rendered->encoded[i]->content;
+         }
+      }
+      this->rendered = this->render(this->rendered->content, compressed);
+      this->event.reset();
+      this->deltas.clear();
+      if (!this->history.empty()) //current version is the last one of the history
+      {
+         this->history.back() = this->rendered;
+      }
+      if (this->snapshot != NULL)
+      {
+         this->snapshot->store(this->uri, this->contentType, this->rendered->content, this->hash);
+      }
+   }
 }
 
 void  DynamicResource::setContent(const std::string& content)
 {
-   this->content = content;
-   this->hash = xcrc32((const unsigned char *)content.c_str(), content.length(), 0xFFFFFFFFuL);
+   uint64_t hash = 0;
+   if (hashMode == HASH_CRC32)
+   {
+      hash = xcrc32((const unsigned char *)content.c_str(), content.length(), 0xFFFFFFFFuL);
+   }
+
+   //compress once, for all clients accepting a content coding
+   string compressed[Compression::ENCODINGS];
+   compress(content, compressed);
+
+   //update content (the hash is computed and the content compressed outside of the lock)
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      if (this->retired)
+      {
+         return;
+      }
+      this->hash = (hashMode == HASH_VERSION) ? (this->hash + 1) : hash;
+      if (this->hash == 0)
+      {
+         this->hash = 1; //value of 0 is reserved, thats why it shall never be a regular hash
+      }
+      this->rendered = this->render(content, compressed); //the previous version stays valid, as long as it is sent
+      this->event.reset();
+      this->deltas.clear();
+      if (this->snapshot != NULL) //persisted in order of the versions
+      {
+         this->snapshot->store(this->uri, this->contentType, content, this->hash);
+      }
+
+      //append to history. drop the oldest versions, when exceeding the limits (the current one is always kept)
+      if (historyDepth > 0)
+      {
+         this->history.push_back(this->rendered);
+         this->historySize += content.length();
+         while ((this->history.size() > historyDepth) ||
+                ((this->historySize > historyBudget) && (this->history.size() > 1)))
+         {
+            this->historySize -= this->history.front()->content.length();
+            this->history.pop_front();
+         }
+      }
+   }
+
+   this->notify();
+}
+
+
+void DynamicResource::setSnapshot(SnapshotStore * store)
+{
+   string contentType;
+   string content;
+   uint64_t hash;
+   if (store->load(this->uri, contentType, content, hash))
+   {
+      string compressed[Compression::ENCODINGS];
+      compress(content, compressed);
+      lock_guard<std::mutex> lock(this->mutex);
+      this->contentType = contentType;
+      this->hash = hash; //clients, knowing that version, stay parked
+      this->rendered = this->render(content, compressed);
+      this->event.reset();
+      this->deltas.clear();
+      if (historyDepth > 0) //restored version replaces the (empty) initial one
+      {
+         this->history.assign(1, this->rendered);
+         this->historySize = content.length();
+      }
+   }
+   lock_guard<std::mutex> lock(this->mutex);
+   this->snapshot = store;
+}
+
+
+void DynamicResource::retire()
+{
+   SnapshotStore * snapshot;
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      snapshot = this->snapshot;
+      this->retired = true;
+      this->snapshot = NULL;
+   }
+   if (snapshot != NULL)
+   {
+      snapshot->remove(this->uri);
+   }
+   this->replace("410 Gone", "Gone");
+   this->notify();
+}
+
+
+void DynamicResource::revive()
+{
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      this->retired = false;
+   }
+   this->replace("200 OK", "");
+}
+
+
+bool DynamicResource::isRetired()
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   return this->retired;
+}
+
+
+string DynamicResource::getStatusCode()
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   return this->statusCode;
+}
+
+
+RenderedContentPtr DynamicResource::getContent()
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   return this->rendered;
+}
+
+
+void DynamicResource::getHistory(uint64_t knownHash, vector<RenderedContentPtr>& versions)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   versions.clear();
+   //search for the known version (from newest to oldest, as CRC32 hashes may repeat)
+   for (size_t i = this->history.size(); i > 0; --i)
+   {
+      if (this->history[i - 1]->hash == knownHash)
+      {
+         versions.assign(this->history.begin() + i, this->history.end());
+         break;
+      }
+   }
+   if (versions.empty()) //unknown (or too old) version
+   {
+      versions.push_back(this->rendered);
+   }
+}
+
+
+RenderedContentPtr DynamicResource::getDelta(uint64_t baseHash)
+{
+   RenderedContentPtr current;
+   RenderedContentPtr base;
+   string contentType;
+   bool found;
+
+   //already computed?
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      RenderedContentPtr delta = this->findDelta(baseHash, found);
+      if (found)
+      {
+         return delta;
+      }
+      current = this->rendered;
+      contentType = this->contentType;
+      for (size_t i = this->history.size(); i > 1; --i) //(the last one is the current version)
+      {
+         if (this->history[i - 2]->hash == baseHash)
+         {
+            base = this->history[i - 2];
+            break;
+         }
+      }
+      if (!base)
+      {
+         return RenderedContentPtr();
+      }
+   }
+
+   //compute delta (outside of the lock, as it takes time proportional to the content)
+   string encoded;
+   DeltaEncoder::encode(base->content, current->content, encoded);
+   RenderedContentPtr delta;
+   if (encoded.length() < current->content.length())
+   {
+      shared_ptr<RenderedContent> rendered = make_shared<RenderedContent>();
+      string header;
+      header  = "HTTP/1.1 226 IM Used\r\n";
+      header += "Content-Type: " + contentType + "\r\n";
+      header += "Content-Hash: " + to_string(current->hash) + "\r\n";
+      header += "Delta-Base: " + to_string(baseHash) + "\r\n";
+      header += "IM: apoll-delta\r\n";
+      header += "Content-Length: " + to_string(encoded.length()) + "\r\n";
+      rendered->header[0] = header + "Connection: close\r\n\r\n";
+      rendered->header[1] = header + "Connection: keep-alive\r\n\r\n";
+      rendered->content.swap(encoded);
+      rendered->hash = current->hash;
+      delta = rendered;
+   }
+
+   //remember delta for other clients knowing the same base version (unless the content has changed meanwhile)
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      if (this->rendered == current)
+      {
+         RenderedContentPtr other = this->findDelta(baseHash, found);
+         if (found) //computed concurrently by another worker
+         {
+            return other;
+         }
+         this->deltas.push_back(make_pair(baseHash, delta));
+      }
+   }
+   return delta;
+}
+
+
+RenderedContentPtr DynamicResource::getEvent(const RenderedContentPtr& version)
+{
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      if ((version == this->rendered) && this->event)
+      {
+         return this->event;
+      }
+   }
+
+   //render (outside of the lock), and remember the event of the current version
+   RenderedContentPtr event = renderEvent(*version);
+   lock_guard<std::mutex> lock(this->mutex);
+   if (version == this->rendered)
+   {
+      if (this->event) //rendered concurrently by another worker
+      {
+         return this->event;
+      }
+      this->event = event;
+   }
+   return event;
+}
+
+
+bool DynamicResource::addWaiter(ReplyQueue& queue, Waiter * waiter, uint64_t knownHash)
+{
+   //the queue's lock is taken before the hash is checked. Thereby a concurrent setContent
+   //either changes the hash before the check, or finds the waiter already parked
+   lock_guard<std::mutex> lock(queue.mutex);
+   {
+      lock_guard<std::mutex> contentLock(this->mutex);
+      if (this->hash != knownHash)
+      {
+         return false;
+      }
+   }
+   WaiterList::unlink(waiter);
+   this->waiters[queue.id].push(waiter);
+   return true;
+}
+
+
+void DynamicResource::removeWaiter(ReplyQueue& queue, Waiter * waiter)
+{
+   lock_guard<std::mutex> lock(queue.mutex);
+   WaiterList::unlink(waiter);
+}
+
+
+void DynamicResource::registerReplyQueue(ReplyQueue * queue)
+{
+   queue->id = replyQueues.size();
+   replyQueues.push_back(queue);
+}
+
+
+void DynamicResource::setHistoryLimits(size_t depth, size_t budget)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   historyDepth = depth;
+   historyBudget = budget;
+   boundary = "apoll-" + to_string(now.tv_sec) + "-" + to_string(now.tv_nsec); //unlikely to be part of any content
+}
+
+
+size_t DynamicResource::getHistoryDepth()
+{
+   return historyDepth;
+}
+
+
+const string& DynamicResource::getBoundary()
+{
+   return boundary;
+}
+
+
+void DynamicResource::setHashMode(HashMode mode)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   hashMode = mode;
+   initialVersion = ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+
+void DynamicResource::setCompression(size_t minSize)
+{
+   compressMinSize = minSize;
+}
+
+
+//search the deltas of the current version (call with locked mutex)
+RenderedContentPtr DynamicResource::findDelta(uint64_t baseHash, bool& found) const
+{
+   for (size_t i = 0; i < this->deltas.size(); ++i)
+   {
+      if (this->deltas[i].first == baseHash)
+      {
+         found = true;
+         return this->deltas[i].second;
+      }
+   }
+   found = false;
+   return RenderedContentPtr();
+}
+
+
+//render server-sent event of the given version
+//each line of the content is sent as "data:" field (CR, LF and CRLF terminate lines)
+RenderedContentPtr DynamicResource::renderEvent(const RenderedContent& version)
+{
+   shared_ptr<RenderedContent> event = make_shared<RenderedContent>();
+   const string& content = version.content;
+   string& text = event->content;
+   text.reserve(content.length() + 32);
+   text = "id: " + to_string(version.hash) + "\n";
+   text += "data: ";
+   for (size_t i = 0; i < content.length(); ++i)
+   {
+      const char c = content[i];
+      if ((c == '\r') || (c == '\n'))
+      {
+         if ((c == '\r') && ((i + 1) < content.length()) && (content[i + 1] == '\n'))
+         {
+            ++i;
+         }
+         text += "\ndata: ";
+         continue;
+      }
+      text += c;
+   }
+   text += "\n\n"; //end of event
+   event->hash = version.hash;
+   return event;
+}
+
+
+//render reply of the given content (call with locked mutex)
+//compressed: compressed content per content coding (may be NULL). only codings, that are smaller, are rendered
+RenderedContentPtr DynamicResource::render(const string& content, const string * compressed) const
+{
+   shared_ptr<RenderedContent> rendered = make_shared<RenderedContent>();
+   string vary;
+   for (int i = 0; (compressed != NULL) && (i < Compression::ENCODINGS); ++i)
+   {
+      if (!compressed[i].empty() && (compressed[i].length() < content.length()))
+      {
+         shared_ptr<RenderedContent> encoded = make_shared<RenderedContent>();
+         string header;
+         header  = "HTTP/1.1 " + this->statusCode + "\r\n";
+         header += "Content-Type: " + this->contentType + "\r\n";
+         header += "Content-Hash: " + to_string(this->hash) + "\r\n";
+         header += "Content-Encoding: " + string(Compression::getName((Compression::Encoding)i)) + "\r\n";
+         header += "Vary: Accept-Encoding\r\n";
+         header += "Content-Length: " + to_string(compressed[i].length()) + "\r\n";
+         encoded->header[0] = header + "Connection: close\r\n\r\n";
+         encoded->header[1] = header + "Connection: keep-alive\r\n\r\n";
+         encoded->content = compressed[i];
+         encoded->hash = this->hash;
+         rendered->encoded[i] = encoded;
+         vary = "Vary: Accept-Encoding\r\n"; //caches must not reply the plain content to clients accepting a coding
+      }
+   }
+
+   string header;
+   header  = "HTTP/1.1 " + this->statusCode + "\r\n";
+   header += "Content-Type: " + this->contentType + "\r\n";
+   header += "Content-Hash: " + to_string(this->hash) + "\r\n";
+   header += vary;
+   header += "Content-Length: " + to_string(content.length()) + "\r\n";
+   rendered->header[0] = header + "Connection: close\r\n\r\n";
+   rendered->header[1] = header + "Connection: keep-alive\r\n\r\n";
+   if (historyDepth > 0)
+   {
+      rendered->part  = "--" + boundary + "\r\n";
+      rendered->part += "Content-Type: " + this->contentType + "\r\n";
+      rendered->part += "Content-Hash: " + to_string(this->hash) + "\r\n";
+      rendered->part += "Content-Length: " + to_string(content.length()) + "\r\n\r\n";
+   }
+   rendered->content = content;
+   rendered->frame = WebSocket::encodeHeader(WebSocket::getDataOpcode(this->contentType), content.length());
+   rendered->hash = this->hash;
+   return rendered;
+}
+
+
+//compress content, if it is large enough (see setCompression); compressed[i] is left empty otherwise (or if it fails)
+void DynamicResource::compress(const string& content, string * compressed)
+{
+   if ((compressMinSize > 0) && (content.length() >= compressMinSize))
+   {
+      for (int i = 0; i < Compression::ENCODINGS; ++i)
+      {
+         if (!Compression::compress((Compression::Encoding)i, content, compressed[i]))
+         {
+            compressed[i].clear(); //(served uncompressed)
+         }
+      }
+   }
+}
+
+
+//replace status and content, dropping all versions before (the hash is changed, thus waiters are replied)
+void DynamicResource::replace(const string& statusCode, const string& content)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   this->statusCode = statusCode;
+   this->contentType = "text/plain";
+   this->hash++; //differs from the current one
    if (this->hash == 0)
    {
-      this->hash = 1; //value of 0 is reserved, thats why it shall never be a regular hash
+      this->hash = 1;
+   }
+   this->rendered = this->render(content);
+   this->event.reset();
+   this->deltas.clear();
+   if (historyDepth > 0)
+   {
+      this->history.assign(1, this->rendered);
+      this->historySize = content.length();
    }
 }
 
+
+//hand over exactly the waiters of this resource for being replied,
+//and wake up those workers having waiters
+void DynamicResource::notify()
+{
+   for (size_t i = 0; i < replyQueues.size(); ++i)
+   {
+      ReplyQueue * queue = replyQueues[i];
+      lock_guard<std::mutex> lock(queue->mutex);
+      if (!this->waiters[i].isEmpty())
+      {
+         queue->waiters.splice(this->waiters[i]);
+         queue->eventLoop->wakeup();
+      }
+   }
+}
@@ -9,25 +9,199 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
 #include <stdint.h>
+#include "compression.h"
 
 
 
 /* -- Defines ------------------------------------------------------------- */
 
 /* -- Types --------------------------------------------------------------- */
+//intrusive list node, embedded into requests that wait for a content change
+struct Waiter
+{
+   Waiter * prev;
+   Waiter * next;
+   void * context; //owner of the node (e.g. the waiting connection)
+};
+
+
+//intrusive, doubly linked list of waiters
+//linking, unlinking and splicing are O(1); nodes are never allocated by the list
+class WaiterList
+{
+public:
+   WaiterList();
+
+   bool isEmpty() const;
+
+   //append waiter to the end of the list (waiter must not be linked elsewhere)
+   void push(Waiter * waiter);
+
+   //return the first waiter (without removing it); NULL if list is empty
+   Waiter * front() const;
+
+   //remove and return the first waiter; NULL if list is empty
+   Waiter * pop();
+
+   //move all waiters of the other list to the end of this list
+   void splice(WaiterList& other);
+
+   //remove waiter from whatever list it is linked to (no-op if not linked)
+   static void unlink(Waiter * waiter);
+   static void init(Waiter * waiter, void * context);
+   static bool isLinked(const Waiter * waiter);
+
+private:
+   WaiterList(const WaiterList&); //non-copyable (sentinel is referenced by its nodes)
+   Waiter head; //sentinel
+};
+
+
+class EventLoop;
+
+
+//collects the waiters of one worker (event loop), whose resource has changed
+//there is one reply queue per worker thread; they must all be registered,
+//before the first dynamic resource is created (see DynamicResource::registerReplyQueue)
+class ReplyQueue
+{
+public:
+   ReplyQueue(EventLoop * eventLoop);
+
+   //move all waiters, whose resource has changed, to the given (thread local) list
+   void takeAll(WaiterList& list);
+
+   unsigned id; //index of this worker's waiter lists within the dynamic resources
+   std::mutex mutex; //protects the queue and the waiter lists of this worker in all resources
+   WaiterList waiters;
+   EventLoop * eventLoop; //woken up, when waiters are queued
+};
+
+
+//immutable, pre-rendered reply of one version of a dynamic resource
+//it is shared by all requests replied with that version, and stays valid while being sent
+//even if the content of the resource is changed meanwhile
+struct RenderedContent
+{
+   std::string header[2]; //status line and header fields; [0]: "Connection: close", [1]: "Connection: keep-alive"
+   std::string part; //boundary and header fields of this version within a batched (multipart) reply; empty if history is disabled
+   std::string content;
+   std::string frame; //header of the WebSocket frame carrying the content
+   uint64_t hash;
+   std::shared_ptr<const RenderedContent> encoded[Compression::ENCODINGS]; //compressed replies (Content-Encoding); NULL if not worth it
+};
+typedef std::shared_ptr<const RenderedContent> RenderedContentPtr;
+
+
+class SnapshotStore;
+
+
 class DynamicResource
 {
 public:
+   //how the Content-Hash of a resource is derived from its content
+   enum HashMode
+   {
+      HASH_CRC32, //CRC32 of the content (default). equal content yields equal hashes
+      HASH_VERSION, //64-bit version, incremented on each setContent (no hashing pass; no collisions)
+   };
+
    DynamicResource(const std::string& uri, const std::string& statusCode="200 OK");
+   ~DynamicResource();
    void setContentType(const std::string& contentType);
+
+   //set content and hash, and render the reply once (for all requests)
+   //content is compressed once, too (see setCompression). compressed replies are referenced by the rendered reply
+   //the waiters of all workers are moved to their reply queues and the workers are woken up
    void setContent(const std::string& content);
 
+   //restore content type, content and hash from the store (if the resource was persisted before), and
+   //persist each further version into it (see SnapshotStore). call before the resource is published
+   void setSnapshot(SnapshotStore * store);
+
+   //withdraw the resource (e.g. removed from the configuration): its content is replaced by "410 Gone", that is
+   //replied to all waiters. further contents are ignored, until the resource is revived (with empty content)
+   //the resource is not deleted, as requests of all workers may still refer to it
+   void retire();
+   void revive();
+   bool isRetired();
+   std::string getStatusCode();
+
+   //return the rendered reply of the current content
+   RenderedContentPtr getContent();
+
+   //return all versions newer than the given hash, oldest first (see setHistoryLimits)
+   //if the given hash is not within the history (anymore), only the current version is returned
+   void getHistory(uint64_t knownHash, std::vector<RenderedContentPtr>& versions);
+
+   //return the rendered delta reply ("226 IM Used") of the current version against the version with the given hash
+   //deltas are computed once per base version (see DeltaEncoder)
+   //returns NULL if the base version is not within the history (anymore), or the delta isn't smaller than the content
+   RenderedContentPtr getDelta(uint64_t baseHash);
+
+   //return the server-sent event of the given version (the event's content is "id: <hash>" and "data: <line>" for
+   //each line of the version's content). the event of the current version is rendered once, for all streams
+   RenderedContentPtr getEvent(const RenderedContentPtr& version);
+
+   //park a request of the given worker until the content differs from the given hash
+   //returns false (and does not park) if the content has already changed
+   bool addWaiter(ReplyQueue& queue, Waiter * waiter, uint64_t knownHash);
+
+   //remove a parked request of the given worker (no-op if not parked)
+   static void removeWaiter(ReplyQueue& queue, Waiter * waiter);
+
+   //register the reply queue of a worker (call before creating any dynamic resource)
+   static void registerReplyQueue(ReplyQueue * queue);
+
+   //keep up to depth recent versions, taking up to budget bytes of content, per resource (depth 0: disabled)
+   //call before creating any dynamic resource
+   static void setHistoryLimits(size_t depth, size_t budget);
+   static size_t getHistoryDepth();
+
+   //boundary, separating the versions of batched (multipart) replies
+   static const std::string& getBoundary();
+
+   //select the hash mode (call before creating any dynamic resource)
+   //versions start at the time of the call (in ns since epoch), thus a restarted server doesn't reuse versions
+   static void setHashMode(HashMode mode);
+
+   //content of at least minSize bytes is compressed (gzip, brotli) when set (0: disabled)
+   static void setCompression(size_t minSize);
+
    std::string uri;
-   std::string content;
    std::string contentType;
    std::string statusCode;
-   uint32_t hash;
+   uint64_t hash;
+   std::mutex mutex; //protects rendered, contentType, statusCode and hash (shared by all workers)
+
+private:
+   RenderedContentPtr render(const std::string& content, const std::string * compressed=NULL) const;
+   static void compress(const std::string& content, std::string * compressed);
+   void replace(const std::string& statusCode, const std::string& content);
+   void notify();
+   RenderedContentPtr findDelta(uint64_t baseHash, bool& found) const;
+   static RenderedContentPtr renderEvent(const RenderedContent& version);
+
+   RenderedContentPtr rendered; //current content
+   std::deque<RenderedContentPtr> history; //recent versions (including the current one), oldest first
+   size_t historySize; //sum of the content lengths within history
+   RenderedContentPtr event; //server-sent event of the current version; NULL until requested
+   std::vector<std::pair<uint64_t, RenderedContentPtr> > deltas; //deltas of the current version, by base hash (NULL: not worth it)
+   WaiterList * waiters; //requests waiting for a content change; one list per worker
+   SnapshotStore * snapshot; //versions are persisted into that store; NULL if not persisted
+   bool retired;
+   static std::vector<ReplyQueue *> replyQueues;
+   static HashMode hashMode;
+   static uint64_t initialVersion; //version of new resources (HASH_VERSION)
+   static size_t historyDepth;
+   static size_t historyBudget;
+   static std::string boundary;
+   static size_t compressMinSize;
 };
 
 
@@ -39,4 +213,4 @@ public:
 
 
 
-#endif // TCPCONNECT_H_INCLUDED
+#endif // DYNAMIC_RESOURCE_H_INCLUDED
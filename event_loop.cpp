@@ -0,0 +1,135 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Edge-triggered epoll event loop with eventfd based wakeup
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <iostream>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+EventLoop::EventLoop()
+{
+   this->epollFd = -1;
+   this->wakeupFd = -1;
+}
+
+
+EventLoop::~EventLoop()
+{
+   this->close();
+}
+
+
+int EventLoop::open()
+{
+   int status;
+
+   //create epoll instance
+   this->epollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (this->epollFd >= 0)
+   {
+      //create eventfd, used to wakeup the loop
+      this->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (this->wakeupFd >= 0)
+      {
+         status = this->add(this->wakeupFd, EPOLLIN | EPOLLET, this);
+         if (status >= 0)
+         {
+            return this->epollFd;
+         }
+      }
+   }
+
+   //something went wrong ...
+   cout << "Failed to create event loop!" << endl;
+   this->close();
+   return -1;
+}
+
+
+void EventLoop::close()
+{
+   if (this->wakeupFd >= 0)
+   {
+      ::close(this->wakeupFd);
+      this->wakeupFd = -1;
+   }
+   if (this->epollFd >= 0)
+   {
+      ::close(this->epollFd);
+      this->epollFd = -1;
+   }
+}
+
+
+int EventLoop::add(int fd, uint32_t events, void * context)
+{
+   struct epoll_event event = { 0 };
+   event.events = events;
+   event.data.ptr = context;
+   return epoll_ctl(this->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+
+int EventLoop::modify(int fd, uint32_t events, void * context)
+{
+   struct epoll_event event = { 0 };
+   event.events = events;
+   event.data.ptr = context;
+   return epoll_ctl(this->epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+
+int EventLoop::remove(int fd)
+{
+   return epoll_ctl(this->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+
+int EventLoop::wait(struct epoll_event * events, int maxEvents, int timeout)
+{
+   int status = epoll_wait(this->epollFd, events, maxEvents, timeout);
+   if ((status < 0) && (errno == EINTR)) //interrupted by signal (e.g. CTRL+C)
+   {
+      return 0;
+   }
+   return status;
+}
+
+
+void EventLoop::wakeup()
+{
+   const uint64_t one = 1;
+   ssize_t status = ::write(this->wakeupFd, &one, sizeof(one)); //async-signal-safe
+   (void)status; //counter overflow (EAGAIN) still leaves the loop signaled
+}
+
+
+void EventLoop::acknowledge()
+{
+   uint64_t counter;
+   while (::read(this->wakeupFd, &counter, sizeof(counter)) > 0);
+}
+
@@ -0,0 +1,63 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Edge-triggered epoll event loop with eventfd based wakeup
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef EVENT_LOOP_H_INCLUDED
+#define EVENT_LOOP_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <sys/epoll.h>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+class EventLoop
+{
+public:
+   EventLoop();
+   ~EventLoop();
+
+   //create the epoll instance and the wakeup eventfd
+   //returns positive number on success; -1 in case of errors
+   int open();
+
+   void close();
+
+   //register a file descriptor for edge-triggered readiness notifications
+   //context is reported back in epoll_event.data.ptr for every event of that descriptor
+   //returns 0 on success; -1 in case of errors
+   int add(int fd, uint32_t events, void * context);
+   int modify(int fd, uint32_t events, void * context);
+   int remove(int fd);
+
+   //block until events are ready or timeout (in ms; -1 = forever) elapsed
+   //returns number of events; 0 on timeout or interruption; -1 in case of errors
+   int wait(struct epoll_event * events, int maxEvents, int timeout);
+
+   //wake up the loop from anywhere (other threads, signal handlers)
+   //the wakeup is reported as an event whose context is this event loop
+   void wakeup();
+
+   //consume pending wakeups (call on receiving the wakeup event)
+   void acknowledge();
+
+private:
+   int epollFd; //file descriptor of epoll instance
+   int wakeupFd; //file descriptor of eventfd
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // EVENT_LOOP_H_INCLUDED
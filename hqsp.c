@@ -1,208 +1,421 @@
-//-----------------------------------------------------------------------------
-/*!
-   \file
-   \brief Http Query String Parser (hqsp)
-*/
-//-----------------------------------------------------------------------------
-
-
-/* -- Includes ------------------------------------------------------------ */
-#include <string.h>
-#include <stdlib.h>
-#include "hqsp.h"
-
-/* -- Defines ------------------------------------------------------------- */
-
-/* -- Types --------------------------------------------------------------- */
-
-/* -- Global Variables ---------------------------------------------------- */
-
-/* -- Module Global Variables --------------------------------------------- */
-
-/* -- Module Global Function Prototypes ----------------------------------- */
-static int is_delimiter(char c);
-
-
-/* -- Implementation ------------------------------------------------------ */
-
-int hqsp_is_method_get(const char * request)
-{
-   int isGet = 1;
-   isGet &= (request[0] == 'G');
-   isGet &= (request[1] == 'E');
-   isGet &= (request[2] == 'T');
-   return isGet;
-}
-
-
-int hqsp_is_method_post(const char * request)
-{
-   int isPost = 1;
-   isPost &= (request[0] == 'P');
-   isPost &= (request[1] == 'O');
-   isPost &= (request[2] == 'S');
-   isPost &= (request[3] == 'T');
-   return isPost;
-}
-
-
-int hqsp_get_resource(const char * request, const char ** x)
-{
-   const char * start;
-   const char * end;
-   int len;
-
-   //find start token '/'
-   for (start = request; *start != '/'; ++start) { if ((*start == 0) || (*start == '\n')) return 0; }
-   *x = start;
-   //determin length
-   for (end = start, len = 0; !is_delimiter(*end); ++end, ++len);
-   //set results
-   return len;
-}
-
-
-
-int hqsp_get_header_value(const char * request, const char * header, const char ** x)
-{
-   const int headerLen = strlen(header);
-   const char * iterator;
-   const char * start;
-   const char * end;
-   int matchLen;
-   int len;
-
-   start = NULL;
-   matchLen = 0;
-   uint32_t shiftReg = 0;
-   const uint32_t endOfHeader = ((uint32_t)'\r' << 24) | ((uint32_t)'\n' << 16) | ((uint32_t)'\r' << 8) | (uint32_t)'\n'; //end of header is indicated by two "\r\n"
-   for (iterator = request; shiftReg != endOfHeader; ++iterator) //until end of header ...
-   {
-      if (*iterator == 0) return 0;
-      shiftReg = (shiftReg  << 8) | (uint8_t)*iterator;
-
-      if (*iterator == header[matchLen]) //match?
-      {
-         ++matchLen; //compare next char of header
-         if (matchLen == headerLen)
-         {
-            //lock ahead if next two chars are ':' and ' '
-            if ((iterator[1] == ':') && (iterator[2] == ' '))//yes
-            {
-               start = &iterator[3]; //set start of value poitner
-               break; //stop searching
-            }
-            matchLen = 0; //otherwise: header not found -> restart comparison from begining
-         }
-         continue;
-      }
-      matchLen = 0; //no match -> restart comparison from begining
-   }
-
-   //check if parameter was found
-   if (start != NULL)
-   {
-      *x = start;
-      //determin length
-      for (end = start, len = 0; *end != '\r'; ++end, ++len); //until end of line (marked by "\r\n")
-      //set results
-      return len;
-   }
-
-   //header not found
-   return 0;
-}
-
-
-int hqsp_get_parameter_value(const char * request, const char * parameter, const char ** x)
-{
-   const int parameterLen = strlen(parameter);
-   const char * iterator;
-   const char * start;
-   const char * end;
-   int matchLen;
-   int len;
-
-   start = NULL;
-   matchLen = 0;
-   for (iterator = request; (*iterator != 0) && (*iterator != '\n'); ++iterator)
-   {
-      if (*iterator == parameter[matchLen]) //match?
-      {
-         ++matchLen; //compare next char of parameter
-         if (matchLen == parameterLen)
-         {
-            //lock ahead if next char is '=' token
-            if (iterator[1] == '=') //yes
-            {
-               start = &iterator[2]; //set start of value poitner
-               break; //stop searching
-            }
-            matchLen = 0; //otherwise: parameter not found -> restart comparison from begining
-         }
-         continue;
-      }
-      matchLen = 0; //no match -> restart comparison from begining
-   }
-
-   //check if parameter was found
-   if (start != NULL)
-   {
-      *x = start;
-      //determin length
-      for (end = start, len = 0; !is_delimiter(*end); ++end, ++len);
-      //set results
-      return len;
-   }
-
-   //parameter not found
-   return 0;
-}
-
-
-int hqsp_get_status_code(const char * response)
-{
-   return atoi(&response[9]);
-}
-
-
-int hqsp_get_post_content(const char * request, const unsigned requestLen, const char ** x)
-{
-   const char * start;
-   unsigned len;
-
-   //find start of post data, preceded by "\r\n\r\n"
-   uint32_t shiftReg = 0;
-   const uint32_t endOfHeader = ((uint32_t)'\r' << 24) | ((uint32_t)'\n' << 16) | ((uint32_t)'\r' << 8) | (uint32_t)'\n';
-   for (start = request, len = 0; shiftReg != endOfHeader; ++start, ++len)
-   {
-      if (*start == 0)
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Http Query String Parser (hqsp)
+*/
+//-----------------------------------------------------------------------------
+
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "hqsp.h"
+
+/* -- Defines ------------------------------------------------------------- */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HQSP_SIMD_X86 //SSE2/AVX2 kernels, selected at runtime
+#include <immintrin.h>
+#endif
+
+/* -- Types --------------------------------------------------------------- */
+//scanning kernels (see select_kernels)
+typedef const char * (*find_byte_t)(const char * s, const char * end, char c);
+typedef const char * (*find_end_of_header_t)(const char * s, const char * end);
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Module Global Variables --------------------------------------------- */
+static find_byte_t find_byte; //returns pointer to the first c within [s, end); end if not found
+static find_end_of_header_t find_end_of_header; //returns pointer behind the first "\r\n\r\n" within [s, end); NULL if not found
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static int is_delimiter(char c);
+static void set_view(hqsp_view_t * view, const char * request, const char * start, const char * end);
+static const char * find_byte_scalar(const char * s, const char * end, char c);
+static const char * find_end_of_header_scalar(const char * s, const char * end);
+#ifdef HQSP_SIMD_X86
+static const char * find_byte_sse2(const char * s, const char * end, char c);
+static const char * find_end_of_header_sse2(const char * s, const char * end);
+static const char * find_byte_avx2(const char * s, const char * end, char c);
+static const char * find_end_of_header_avx2(const char * s, const char * end);
+#endif
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int hqsp_is_method_get(const char * request)
+{
+   int isGet = 1;
+   isGet &= (request[0] == 'G');
+   isGet &= (request[1] == 'E');
+   isGet &= (request[2] == 'T');
+   return isGet;
+}
+
+
+int hqsp_is_method_post(const char * request)
+{
+   int isPost = 1;
+   isPost &= (request[0] == 'P');
+   isPost &= (request[1] == 'O');
+   isPost &= (request[2] == 'S');
+   isPost &= (request[3] == 'T');
+   return isPost;
+}
+
+
+int hqsp_get_resource(const char * request, const char ** x)
+{
+   const char * start;
+   const char * end;
+   int len;
+
+   //find start token '/'
+   for (start = request; *start != '/'; ++start) { if ((*start == 0) || (*start == '\n')) return 0; }
+   *x = start;
+   //determin length
+   for (end = start, len = 0; !is_delimiter(*end); ++end, ++len);
+   //set results
+   return len;
+}
+
+
+
+int hqsp_get_header_value(const char * request, unsigned len, const char * header, const char ** x)
+{
+   const int headerLen = strlen(header);
+   const char * line;
+   const char * start;
+   const char * end;
+
+   //end of header is indicated by two "\r\n"
+   end = find_end_of_header(request, request + len);
+   if (end == NULL) return 0;
+
+   //compare the header fields, line by line (skip the request line)
+   for (line = find_byte(request, end, '\n') + 1; line < end; line = find_byte(line, end, '\n') + 1)
+   {
+      //line starts with header, followed by ':' and ' '?
+      if (((end - line) > (headerLen + 2)) && (memcmp(line, header, headerLen) == 0) && (line[headerLen] == ':') && (line[headerLen + 1] == ' '))
       {
+         start = &line[headerLen + 2]; //set start of value poitner
+         *x = start;
+         //determin length
+         return (int)(find_byte(start, end, '\r') - start); //until end of line (marked by "\r\n")
+      }
+   }
+
+   //header not found
+   return 0;
+}
+
+
+unsigned hqsp_get_header_length(const char * request, unsigned len)
+{
+   const char * end = find_end_of_header(request, request + len);
+   return (end != NULL) ? (unsigned)(end - request) : 0;
+}
+
+
+unsigned hqsp_parse_request(const char * request, unsigned len, hqsp_request_t * parsed)
+{
+   const char * const end = request + len;
+   const char * line;
+   const char * lineEnd; //'\n' of the line
+   const char * eol; //end of line content (without "\r\n")
+   const char * p;
+   const char * q;
+
+   parsed->headerCount = 0;
+   parsed->tooManyHeaders = 0;
+   parsed->headerLength = 0;
+
+   //request line: method SP resource ['?' query] SP version
+   lineEnd = find_byte(request, end, '\n');
+   if (lineEnd == end) return 0; //incomplete
+   eol = ((lineEnd > request) && (lineEnd[-1] == '\r')) ? (lineEnd - 1) : lineEnd;
+   p = find_byte(request, eol, ' ');
+   set_view(&parsed->method, request, request, p);
+   p = (p < eol) ? (p + 1) : eol;
+   q = find_byte(p, eol, ' '); //end of resource and query
+   line = find_byte(p, q, '?');
+   set_view(&parsed->resource, request, p, line);
+   set_view(&parsed->query, request, (line < q) ? (line + 1) : q, q);
+   q = (q < eol) ? (q + 1) : eol;
+   set_view(&parsed->version, request, q, eol);
+
+   //header fields: name ':' value, until the empty line
+   for (line = lineEnd + 1; ; line = lineEnd + 1)
+   {
+      lineEnd = find_byte(line, end, '\n');
+      if (lineEnd == end) return 0; //incomplete
+      if ((lineEnd == (line + 1)) && (line[0] == '\r')) //empty line -> end of header
+      {
+         break;
+      }
+      eol = ((lineEnd > line) && (lineEnd[-1] == '\r')) ? (lineEnd - 1) : lineEnd;
+      p = find_byte(line, eol, ':');
+      if (p < eol) //otherwise: malformed line, ignored
+      {
+         if (parsed->headerCount >= HQSP_MAX_HEADERS) //(a field, that is dropped, may be essential, e.g. Content-Length)
+         {
+            parsed->tooManyHeaders = 1;
+         }
+         else
+         {
+            hqsp_header_t * field = &parsed->headers[parsed->headerCount++];
+            set_view(&field->name, request, line, p);
+            //strip white space around the value
+            for (++p; (p < eol) && ((*p == ' ') || (*p == '\t')); ++p);
+            for (; (eol > p) && ((eol[-1] == ' ') || (eol[-1] == '\t')); --eol);
+            set_view(&field->value, request, p, eol);
+         }
+      }
+   }
+
+   parsed->headerLength = (unsigned)(lineEnd + 1 - request);
+   return parsed->headerLength;
+}
+
+
+int hqsp_get_parsed_header_value(const char * request, const hqsp_request_t * parsed, const char * header, const char ** x)
+{
+   const unsigned headerLen = strlen(header);
+   unsigned i;
+
+   for (i = 0; i < parsed->headerCount; ++i)
+   {
+      const hqsp_header_t * field = &parsed->headers[i];
+      if ((field->name.length == headerLen) && (strncasecmp(&request[field->name.offset], header, headerLen) == 0))
+      {
+         *x = &request[field->value.offset];
+         return (int)field->value.length;
+      }
+   }
+
+   //header not found
+   return 0;
+}
+
+
+int hqsp_view_equals(const char * request, hqsp_view_t view, const char * s)
+{
+   return (view.length == strlen(s)) && (memcmp(&request[view.offset], s, view.length) == 0);
+}
+
+
+int hqsp_get_parameter_value(const char * request, const char * parameter, const char ** x)
+{
+   const int parameterLen = strlen(parameter);
+   const char * iterator;
+   const char * start;
+   const char * end;
+   int matchLen;
+   int len;
+
+   start = NULL;
+   matchLen = 0;
+   for (iterator = request; (*iterator != 0) && (*iterator != '\n'); ++iterator)
+   {
+      if (*iterator == parameter[matchLen]) //match?
+      {
+         ++matchLen; //compare next char of parameter
+         if (matchLen == parameterLen)
+         {
+            //lock ahead if next char is '=' token
+            if (iterator[1] == '=') //yes
+            {
+               start = &iterator[2]; //set start of value poitner
+               break; //stop searching
+            }
+            matchLen = 0; //otherwise: parameter not found -> restart comparison from begining
+         }
+         continue;
+      }
+      matchLen = 0; //no match -> restart comparison from begining
+   }
+
+   //check if parameter was found
+   if (start != NULL)
+   {
+      *x = start;
+      //determin length
+      for (end = start, len = 0; !is_delimiter(*end); ++end, ++len);
+      //set results
+      return len;
+   }
+
+   //parameter not found
+   return 0;
+}
+
+
+int hqsp_get_status_code(const char * response)
+{
+   return atoi(&response[9]);
+}
+
+
+int hqsp_get_post_content(const char * request, const unsigned requestLen, const char ** x)
+{
+   const char * start;
+
+   //find start of post data, preceded by "\r\n\r\n"
+   start = find_end_of_header(request, request + requestLen);
+   if (start == NULL)
+   {
       return 0;
-      }
-      shiftReg = (shiftReg  << 8) | (uint8_t)*start;
-   }
-   *x = start;
-   //determin remaining length
-   return (requestLen - len);
-}
-
-
-
-//check if char of query string is a delimiter token
-static int is_delimiter(char c)
-{
-   switch (c)
-   {
-   case 0:
-   case '\r': //0x0D
-   case '\n': //0x0A
-   case ' ':
-   case '?':
-   case '&':
-      return 1;
-   }
-   return 0;
-}
-
-
+   }
+   *x = start;
+   //determin remaining length
+   return (requestLen - (unsigned)(start - request));
+}
+
+
+
+//check if char of query string is a delimiter token
+static int is_delimiter(char c)
+{
+   switch (c)
+   {
+   case 0:
+   case '\r': //0x0D
+   case '\n': //0x0A
+   case ' ':
+   case '?':
+   case '&':
+      return 1;
+   }
+   return 0;
+}
+
+
+
+static void set_view(hqsp_view_t * view, const char * request, const char * start, const char * end)
+{
+   view->offset = (unsigned)(start - request);
+   view->length = (unsigned)(end - start);
+}
+
+
+//select the scanning kernels, depending on the instruction sets supported by the CPU (once, at program start)
+__attribute__((constructor)) static void select_kernels(void)
+{
+   find_byte = find_byte_scalar;
+   find_end_of_header = find_end_of_header_scalar;
+#ifdef HQSP_SIMD_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2"))
+   {
+      find_byte = find_byte_sse2;
+      find_end_of_header = find_end_of_header_sse2;
+   }
+   if (__builtin_cpu_supports("avx2"))
+   {
+      find_byte = find_byte_avx2;
+      find_end_of_header = find_end_of_header_avx2;
+   }
+#endif
+}
+
+
+static const char * find_byte_scalar(const char * s, const char * end, char c)
+{
+   for (; (s < end) && (*s != c); ++s);
+   return s;
+}
+
+
+static const char * find_end_of_header_scalar(const char * s, const char * end)
+{
+   const char * p;
+   for (p = s + 3; p < end; ++p) //p: candidate for the last '\n'
+   {
+      if ((p[0] == '\n') && (p[-1] == '\r') && (p[-2] == '\n') && (p[-3] == '\r'))
+      {
+         return p + 1;
+      }
+   }
+   return NULL;
+}
+
+
+#ifdef HQSP_SIMD_X86
+//the SIMD kernels process 16 (SSE2) or 32 (AVX2) bytes at once, using unaligned loads
+//that never exceed end. the remaining bytes are processed by the scalar kernels
+
+__attribute__((target("sse2"))) static const char * find_byte_sse2(const char * s, const char * end, char c)
+{
+   const __m128i needle = _mm_set1_epi8(c);
+   for (; (end - s) >= 16; s += 16)
+   {
+      const unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)s), needle));
+      if (mask != 0)
+      {
+         return s + __builtin_ctz(mask);
+      }
+   }
+   return find_byte_scalar(s, end, c);
+}
+
+
+//each byte is compared to '\n', and the 3 bytes in front of it to "\r\n\r" (by means of shifted loads)
+__attribute__((target("sse2"))) static const char * find_end_of_header_sse2(const char * s, const char * end)
+{
+   const __m128i cr = _mm_set1_epi8('\r');
+   const __m128i lf = _mm_set1_epi8('\n');
+   const char * p;
+   for (p = s + 3; (end - p) >= 16; p += 16)
+   {
+      __m128i match = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), lf);
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 1)), cr));
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 2)), lf));
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p - 3)), cr));
+      const unsigned mask = (unsigned)_mm_movemask_epi8(match);
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask) + 1;
+      }
+   }
+   return find_end_of_header_scalar(p - 3, end);
+}
+
+
+__attribute__((target("avx2"))) static const char * find_byte_avx2(const char * s, const char * end, char c)
+{
+   const __m256i needle = _mm256_set1_epi8(c);
+   for (; (end - s) >= 32; s += 32)
+   {
+      const unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)s), needle));
+      if (mask != 0)
+      {
+         return s + __builtin_ctz(mask);
+      }
+   }
+   return find_byte_sse2(s, end, c);
+}
+
+
+__attribute__((target("avx2"))) static const char * find_end_of_header_avx2(const char * s, const char * end)
+{
+   const __m256i cr = _mm256_set1_epi8('\r');
+   const __m256i lf = _mm256_set1_epi8('\n');
+   const char * p;
+   for (p = s + 3; (end - p) >= 32; p += 32)
+   {
+      __m256i match = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), lf);
+      match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 1)), cr));
+      match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 2)), lf));
+      match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p - 3)), cr));
+      const unsigned mask = (unsigned)_mm256_movemask_epi8(match);
+      if (mask != 0)
+      {
+         return p + __builtin_ctz(mask) + 1;
+      }
+   }
+   return find_end_of_header_sse2(p - 3, end);
+}
+#endif
+
+
@@ -1,72 +1,117 @@
-//-----------------------------------------------------------------------------
-/*!
-   \file
-   \brief Http Query String Parser (hqsp)
-
-   - Get request methond: GET/POST
-   - Get requested resource (e.g. submit.html)
-   - Get value of GET parameter (e.g. value='pass' -> value='wgk3S')
-
-   Examples:
-   ---------
-   GET /config.html HTTP/1.1
-   GET /submit.html?ssid=HEISS&pass=wgk3S HTTP/1.1
-   POST /api/setTemperature/kitchen
-*/
-//-----------------------------------------------------------------------------
-#ifndef HQSP_H_
-#define HQSP_H_
-
-/* -- Includes ------------------------------------------------------------ */
-#include <stdint.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-/* -- Defines ------------------------------------------------------------- */
-
-/* -- Types --------------------------------------------------------------- */
-
-/* -- Global Variables ---------------------------------------------------- */
-
-/* -- Function Prototypes ------------------------------------------------- */
-
-//returns 0 (false) or 1 (true)
-int hqsp_is_method_get(const char * request);
-
-//returns 0 (false) or 1 (true)
-int hqsp_is_method_post(const char * request);
-
-//get "string-pointer" to requested resource
-//x will be set to the start of the string
-//returns length of string
-int hqsp_get_resource(const char * request, const char ** x);
-
-//get "string-pointer" to value of the given header
-//x will be set to the start of the string
-//returns length of string; 0 if request doesn't contain the given header
-int hqsp_get_header_value(const char * request, const char * header, const char ** x);
-
-//get "string-pointer" to value of the given parameter
-//x will be set to the start of the string
-//returns length of string; 0 if request doesn't contain the given paramete
-int hqsp_get_parameter_value(const char * request, const char * parameter, const char ** x);
-
-//returns the http status code (e.g. 200, 404, etc)
-int hqsp_get_status_code(const char * response);
-
-//get "string-pointer" to requested resource
-//x will be set to the start of the string
-//returns length of string
-int hqsp_get_post_content(const char * request, const unsigned requestLen, const char ** x);
-
-/* -- Implementation ------------------------------------------------------ */
-
-
-
-#ifdef __cplusplus
-} /* end of extern "C" */
-#endif
-
-#endif
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Http Query String Parser (hqsp)
+
+   - Get request methond: GET/POST
+   - Get requested resource (e.g. submit.html)
+   - Get value of GET parameter (e.g. value='pass' -> value='wgk3S')
+
+   Examples:
+   ---------
+   GET /config.html HTTP/1.1
+   GET /submit.html?ssid=HEISS&pass=wgk3S HTTP/1.1
+   POST /api/setTemperature/kitchen
+*/
+//-----------------------------------------------------------------------------
+#ifndef HQSP_H_
+#define HQSP_H_
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -- Defines ------------------------------------------------------------- */
+#define HQSP_MAX_HEADERS   32 //max. number of header fields of a request tokenized by hqsp_parse_request (see tooManyHeaders)
+
+/* -- Types --------------------------------------------------------------- */
+//token of a request, given by its offset (from the start of the request) and length
+typedef struct
+{
+   unsigned offset;
+   unsigned length;
+} hqsp_view_t;
+
+//header field (e.g. "Content-Type: text/plain")
+typedef struct
+{
+   hqsp_view_t name;
+   hqsp_view_t value; //without leading and trailing white space
+} hqsp_header_t;
+
+//request, tokenized by hqsp_parse_request
+typedef struct
+{
+   hqsp_view_t method; //e.g. "GET"
+   hqsp_view_t resource; //e.g. "/submit.html" (without query string)
+   hqsp_view_t query; //e.g. "ssid=HEISS&pass=wgk3S"; length 0 if there is no query string
+   hqsp_view_t version; //e.g. "HTTP/1.1"
+   hqsp_header_t headers[HQSP_MAX_HEADERS];
+   unsigned headerCount; //number of valid header fields
+   int tooManyHeaders; //1 if the header has more than HQSP_MAX_HEADERS fields (they are not all tokenized, thus the request must be rejected)
+   unsigned headerLength; //length of the header, including the terminating empty line (= offset of the content)
+} hqsp_request_t;
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+//returns 0 (false) or 1 (true)
+int hqsp_is_method_get(const char * request);
+
+//returns 0 (false) or 1 (true)
+int hqsp_is_method_post(const char * request);
+
+//get "string-pointer" to requested resource
+//x will be set to the start of the string
+//returns length of string
+int hqsp_get_resource(const char * request, const char ** x);
+
+//get "string-pointer" to value of the given header
+//only the first len bytes of the request are considered (the content following the header is never scanned)
+//x will be set to the start of the string
+//returns length of string; 0 if request doesn't contain the given header
+int hqsp_get_header_value(const char * request, unsigned len, const char * header, const char ** x);
+
+//get length of the header (including the terminating empty line), by searching the first len bytes of the request
+//returns length of header; 0 if the header is incomplete
+unsigned hqsp_get_header_length(const char * request, unsigned len);
+
+//tokenize request line and header fields of a request in a single pass
+//only the first len bytes of the request are considered
+//returns length of header (see hqsp_get_header_length); 0 if the header is incomplete
+unsigned hqsp_parse_request(const char * request, unsigned len, hqsp_request_t * parsed);
+
+//get "string-pointer" to value of the given header of a tokenized request (header names are case-insensitive)
+//x will be set to the start of the string
+//returns length of string; 0 if request doesn't contain the given header
+int hqsp_get_parsed_header_value(const char * request, const hqsp_request_t * parsed, const char * header, const char ** x);
+
+//returns 1 (true) if the token equals the given string (case-sensitive); 0 (false) otherwise
+int hqsp_view_equals(const char * request, hqsp_view_t view, const char * s);
+
+//get "string-pointer" to value of the given parameter
+//x will be set to the start of the string
+//returns length of string; 0 if request doesn't contain the given paramete
+int hqsp_get_parameter_value(const char * request, const char * parameter, const char ** x);
+
+//returns the http status code (e.g. 200, 404, etc)
+int hqsp_get_status_code(const char * response);
+
+//get "string-pointer" to requested resource
+//x will be set to the start of the string
+//returns length of string
+int hqsp_get_post_content(const char * request, const unsigned requestLen, const char ** x);
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif
@@ -3,7 +3,7 @@
    \file
    \brief Apoll: Simple web server supporting long polling.
 
-   This implementation is based on a super-loop application with non-blocking sockets.
+   This implementation is based on an epoll event loop with non-blocking sockets.
    The server can handle static content, as every other webserver. In addition it can
    handle so called "dynamic content". Thats content that is pushed the server via POST
    requests and pulled from the server using GET request. Dynamic content is identified by
@@ -25,55 +25,218 @@
 
    Usage:
    ------
-   Usage: apoll [HTML-base-path] [TCP-port-number]
+   Usage: apoll [HTML-base-path] [TCP-port-number] [--workers N] [--max-body BYTES] [--idle-timeout SECONDS]
+                [--header-timeout SECONDS] [--poll-timeout SECONDS] [--max-connections N]
+                [--backlog N] [--defer-accept SECONDS] [--fastopen N] [--static-cache BYTES] [--high-water BYTES] [--content-hash crc32|version]
+                [--history N] [--history-bytes BYTES] [--compress BYTES] [--snapshot FILE] [--max-topics N]
    - HTML-base-path:
       Absolute or relative path to the base folder that shall be served by apoll.
       The path must not be prepended with a '/'. E.g. '/home/users/webmaster/www'
       or '~/www' etc. Default is '.'
       Within that folder, must be a file called 'dynres.txt' that contains the definition
       of all the available, dynamic resources specified line-by-line. One line specifies
-      the URI of the dynamic resource, e.g. '/getTemperature' or '/api/service/xy'
+      the URI of the dynamic resource, e.g. '/getTemperature' or '/api/service/xy'.
+      A line ending with '*' specifies a pattern, e.g. '/sensors/' followed by '*' for all
+      URIs starting with '/sensors/'. The resource of such a URI is created by its first
+      POST request (or when it is restored from the snapshot). URIs listed literally take
+      precedence over patterns, and longer patterns over shorter ones.
+      The file is reloaded whenever it is written or replaced: new URIs are served
+      immediately, deferred requests of removed URIs are replied "410 Gone" (event streams
+      and WebSockets are closed) and all other resources keep their content.
 
    - TPC-port-number:
       The TCP port number apoll shall listen to. E.g. 8080. Default is 8083.
 
+   - --workers N:
+      Number of worker threads. Each worker has its own listen socket (SO_REUSEPORT),
+      event loop and set of connections. The dynamic resources are shared among all
+      workers; a POST on any worker wakes the deferred requests on all workers. Default is 1.
+
+   - --max-body BYTES:
+      Max. size of the content of a POST request. Larger requests are answered with
+      "413 Payload Too Large". Default is 1048576 (1 MiB).
+
+   - --idle-timeout SECONDS:
+      Persistent (keep-alive) connections without pending request are closed after
+      that time of inactivity. Default is 60.
+
+   - --header-timeout SECONDS:
+      Connections are closed, if the header of a request is not received completely
+      within that time (from its first byte). Default is 10.
+
+   - --poll-timeout SECONDS:
+      Deferred requests, whose resource doesn't change within that time, are replied
+      "304 Not Modified" with the "Content-Hash" known by the client (the client repeats
+      the request with it). Default is 0 (deferred requests wait until the content changes).
+      Server-sent event streams and WebSocket connections are never timed out.
+      Connections waiting without timeout are probed by TCP keepalive after the idle
+      timeout; they are closed, if the client doesn't answer (e.g. its host is gone).
+
+   - --max-connections N:
+      Max. number of connections per worker. Further connections are accepted and closed
+      immediately. Connection objects are allocated in chunks (up to that number) and
+      reused, so accepting and closing connections doesn't allocate memory. Default is 65536.
+
+   - --backlog N:
+      Max. number of connections per worker, waiting to be accepted (capped by
+      net.core.somaxconn). Default is SOMAXCONN.
+
+   - --defer-accept SECONDS:
+      Connections are only accepted, once the client has sent data (TCP_DEFER_ACCEPT).
+      Connections without data are dropped by the kernel after that time. Default is 0
+      (disabled).
+
+   - --fastopen N:
+      Enables TCP Fast Open, with at most N pending requests. Clients, knowing a TFO cookie,
+      may send the request within the SYN. Default is 0 (disabled).
+
+   - --static-cache BYTES:
+      Memory budget of the in-memory cache of static files (least recently used files
+      are evicted). Cached files are invalidated by inotify. 0 disables the cache.
+      Default is 67108864 (64 MiB). Files larger than 1/8 of the budget are never read
+      into memory; they are streamed by sendfile.
+
+   - --high-water BYTES:
+      Replies, that can't be sent immediately, are queued per connection and sent when the
+      socket becomes writable. While more than that many bytes are queued, no further
+      requests of that connection are processed. Default is 1048576 (1 MiB).
+
+   - --content-hash crc32|version:
+      How the Content-Hash of dynamic resources is derived. "crc32" (default) is the CRC32
+      of the content. "version" is a 64-bit version, that is incremented on every POST.
+      It is set without a hashing pass and can't collide. Versions are seeded with the
+      start time of the server, so that a restarted server doesn't reuse them.
+
+   - --history N:
+      Number of recent versions kept per dynamic resource. Default is 0 (disabled).
+      A GET request with "Content-Hash" set and "Accept: multipart/mixed" is replied with
+      all versions newer than the known one at once, as "multipart/mixed" message. Each
+      part carries the "Content-Type", "Content-Hash" and "Content-Length" of its version.
+      If the known version is not within the history (anymore), only the current version
+      is replied.
+
+   - --history-bytes BYTES:
+      Max. size of the versions kept per dynamic resource (the current version is always
+      kept). Default is 1048576 (1 MiB).
+
+   - --compress BYTES:
+      Content of dynamic resources of at least that many bytes is compressed (gzip; brotli,
+      if built with it) once per version, when it is set. Clients sending "Accept-Encoding"
+      get the compressed reply (if it is smaller), without compressing it per request.
+      Compression runs on the publish path (POST), thus it is opt-in. E.g. 256 compresses
+      all but tiny contents. Default is 0 (disabled).
+      Static files are never compressed by the server. Instead precompressed siblings
+      (e.g. "file.html.br", "file.html.gz") are served, if they exist.
+
+   - --snapshot FILE:
+      Persists the latest version (content type, content and Content-Hash) of each dynamic
+      resource into FILE (relative paths are relative to the HTML base path), whenever it
+      is set. The file is a memory mapped, append-only log, that is compacted when most of
+      it is outdated. On start, the resources are restored from it, thus clients resume
+      long polling with their known Content-Hash after a restart. The file is never served
+      as static content. Default is none (not persisted).
+
+   - --max-topics N:
+      Max. number of resources created on demand by patterns in dynres.txt (see
+      HTML-base-path). Further POST requests to new URIs are answered with
+      "503 Service Unavailable". Default is 100000.
+
+
+   Delta Replies:
+   --------------
+   If a history is kept (--history), a GET request with "Content-Hash" set and
+   "A-IM: apoll-delta" is replied with a delta against the known version (RFC 3229), as
+   long as that version is within the history and the delta is smaller than the content.
+   Such replies have the status "226 IM Used" and the headers "IM: apoll-delta" and
+   "Delta-Base" (the known version). "Content-Hash" is the version after applying the delta.
+   The content is a sequence of instructions, building the new version:
+   - 0x01 offset length: append length bytes of the known version, starting at offset
+   - 0x02 length data: append the length bytes of data following the instruction
+   Numbers are encoded as unsigned LEB128 (7 bits per byte, least significant first).
+   Otherwise the whole content is replied (status "200 OK").
+
+
+   Server-Sent Events:
+   -------------------
+   A GET request of a dynamic resource with "Accept: text/event-stream" subscribes to the
+   resource. The connection stays open and each version of the resource is sent as event,
+   with the "Content-Hash" as event id (one "data" line per line of the content). The
+   current version is sent immediately. A reconnecting client may set "Last-Event-ID" to
+   continue with the versions following that event (as far as they are within the history;
+   otherwise with the current version).
+
+
+   WebSocket:
+   ----------
+   A GET request of a dynamic resource with "Upgrade: websocket", "Connection: Upgrade",
+   "Sec-WebSocket-Version: 13" and "Sec-WebSocket-Key" upgrades the connection to the
+   WebSocket protocol (other versions are rejected by "426 Upgrade Required", incomplete
+   handshakes by "400 Bad Request"). Each version of the resource is sent as frame (text
+   frames for textual content types; binary frames otherwise), starting with the version
+   following the one given by "Content-Hash" (if any). Each message received from the
+   client is published as new content of the resource (like a POST; the client receives
+   its own messages, too). Messages are limited by --max-body.
+
 
    Program Flow:
    -------------
-   1) A server socket is listening for incomming connections. Whenever the server socket
-   accepts a new connection, that connection is added to a list of active connections.
-
-   2) All active connections are polled for incomming messages, cyclicalliy. If a
-   connection was closed remotely, it is removed from the list of active connections.
+   Each worker is driven by an edge-triggered epoll event loop. The loop sleeps until
+   one of the following events is reported:
+
+   1) The server socket is readable. All pending connections are accepted and added to
+   the set of active connections. Each connection is registered with the event loop.
+   When the process runs out of file descriptors, pending connections are accepted into
+   a reserved descriptor and closed right away (instead of being stuck in the backlog).
+
+   2) A connection is readable. All available data is received into the (growable) request
+   buffer of the connection. A request is processed when its header (terminated by an empty
+   line) and Content-Length bytes of content were received. If the connection was
+   closed remotely, it is removed from the set of active connections.
    However if a HTML request is received on an active connection, the HTML method (GET or POST)
    defines the subsequent processing:
 
    2a) GET:
    --------
-   First it is checked, if the requestd resource is static content, provided by a file.
-   If that true, the file content is replied, the connection is closed and removed
-   from the list of active connections.
-   Otherwise, it is checked if the request resource is dynamic content. If thats true,
-   The request is deferred for subsequent processing.
-   If the request addresses neither available static nor available dynamic content,
-   the request is anwsered with a "404 Not Found" reply. The connection is closed and
-   removed from the list of active connections.
+   First the requested resource is looked up among the dynamic resources (URIs listed in
+   dynres.txt and topics, that were created by a pattern). If it is one, the content is
+   replied right away, when the client doesn't know it yet (*). Otherwise the request is
+   deferred for subsequent processing. Clients may also subscribe to a dynamic resource as
+   stream of server-sent events, or upgrade the connection to the WebSocket protocol.
+   Only if the resource isn't dynamic, it is checked, if it is static content, provided by
+   a file (served from the static file cache, when possible). If that's true, the file
+   content is replied.
+   If the request addresses neither available dynamic nor available static content, the
+   request is answered with a "404 Not Found" reply.
 
    2b) POST:
    ---------
    POST request are only possible for dynamic content. Therefore it is checked, if the
-   requested resource is dynamic content. It thats true, the POST data of the request
-   is stored in the respective "dynamic-resource-object". The request is answered with
-   a "200 OK" reply. The connection is closed and removed from the list of active
-   connections.
-   If the requested dynamic content is not available, the request is answered with a
-   "400 Not Found". The connection is closed and removed from the list of active
-   connections.
-
-   3) For all active connections, with a pending, deferred request, the server compares
-   the HASH value of the request with the HASH value of the resource.If they are different,
-   the request is answered with a "200 OK" reply, the content and the new HASH. The
-   connection is closed and removed from the list of active  connections.
+   requested resource is dynamic content (or matches a pattern, creating the topic). If
+   that's true, the POST data of the request is stored in the respective
+   "dynamic-resource-object" and the event loop is woken up (eventfd). The request is
+   answered with a "200 OK" reply.
+   If the resource was removed from dynres.txt, the request is answered with "410 Gone";
+   if it is not available at all, with "404 Not Found".
+
+   3) The wakeup eventfd is readable, because the content of a dynamic resource has changed.
+   Each dynamic resource keeps a list of its deferred requests (waiters). On a content
+   change, exactly these waiters are moved to the reply queue. For each of them the server
+   compares the HASH value of the request with the HASH value of the resource. If they are
+   different, the request is answered with a "200 OK" reply, the content and the new HASH
+   (streams get the new version as event or frame).
+
+   4) Persistent connections: The connection is only closed after a reply, if the client
+   requested so ("Connection: close" or HTTP/1.0 without "Connection: keep-alive").
+   Otherwise further requests are served on the same connection. Pipelined requests are
+   processed in order - a request following a deferred request is processed after the
+   deferred request was replied. Connections without pending request are closed after
+   the idle timeout.
+
+   5) Timeouts: Each connection has one timer within the hierarchical timer wheel of its
+   worker (arming, cancelling and expiry are O(1)). Depending on the state of the connection
+   it is the idle timeout, the header timeout or the long polling timeout. Connections
+   without timer (streams, deferred requests without poll timeout) are probed by TCP
+   keepalive instead, thus half-open connections don't pile up.
 
 
    ---------------------------------------------------------
@@ -90,11 +253,29 @@
 #include <string>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <signal.h>
 #include <list>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <time.h>
+#include <sys/inotify.h>
 #include "tcp_connection.h"
+#include "event_loop.h"
 #include "dynamic_resource.h"
+#include "route_table.h"
+#include "request_buffer.h"
+#include "static_cache.h"
+#include "timer_wheel.h"
+#include "slab.h"
+#include "websocket.h"
+#include "compression.h"
+#include "snapshot_store.h"
 #include "hqsp.h"
 
 
@@ -102,27 +283,119 @@
 /* -- Defines ------------------------------------------------------------- */
 using namespace std;
 
+#define MAX_EVENTS         256 //max. number of events processed per event loop iteration
+#define RECV_CHUNK_SIZE    4096 //number of bytes received at once
+#define MAX_HEADER_SIZE    16384 //max. size of a request header
+#define KEEPALIVE_INTERVAL 10 //time in s between TCP keepalive probes of connections waiting without timer
+#define KEEPALIVE_PROBES   3 //number of unanswered probes, after which such a connection is closed
+
 
 /* -- Types --------------------------------------------------------------- */
+//meaning of the timer of a connection
+typedef enum
+{
+   TIMEOUT_NONE, //timer not armed (streams)
+   TIMEOUT_IDLE, //no request pending (or slow reader) -> close
+   TIMEOUT_HEADER, //header of a request not received completely -> close
+   TIMEOUT_POLL, //deferred request not replied -> reply "304 Not Modified"
+} Timeout;
+
+
 typedef struct
 {
-   NbTcpConnection * connection;
+   uint32_t slot; //index within the connection slab of the worker
+   NbTcpConnection connection;
    DynamicResource * resource;
-   uint32_t hash;
+   uint64_t hash;
+   bool batch; //reply all versions newer than hash at once (multipart), instead of the current one
+   bool delta; //reply the current version as delta against the version with the given hash, if possible
+   bool stream; //send each version as server-sent event, until the connection is closed (Accept: text/event-stream)
+   bool streaming; //header of the event stream was sent
+   bool websocket; //connection was upgraded to the WebSocket protocol (versions are streamed as frames)
+   string message; //fragments of a WebSocket message, received so far
+   uint8_t messageOpcode; //opcode of the fragmented WebSocket message; CONTINUATION if none is in progress
+   Waiter waiter; //links a deferred request into the waiter list of its resource
+   RequestBuffer request; //received data, until a request is complete
+   bool keepAlive; //keep connection open after the reply of the current request
+   unsigned encodings; //content codings accepted for the reply of the current request (see Compression::parseAcceptEncoding)
+   Timer timer; //links the connection into the timer wheel of its worker
+   Timeout timeout; //meaning of the timer
+   bool probed; //TCP keepalive probes are enabled (connection waited without timer)
+   bool closing; //close connection once all queued data was sent
 } Connection;
 
 
+typedef struct
+{
+   EventLoop * eventLoop;
+   NbTcpServer * tcpServer; //own listen socket (SO_REUSEPORT, when running multiple workers)
+   ReplyQueue * replyQueue; //deferred requests of this worker, whose resource has changed
+   Slab<Connection> * connections; //active connections (objects are reused, to accept and close without allocations)
+   TimerWheel * timers; //idle, header and long polling timeouts of the connections
+   int reserveFd; //spare file descriptor, released to shed pending connections when out of descriptors
+   shared_ptr<const RouteTable> routes; //routes used by this worker (until the generation changes)
+   uint64_t routesGeneration;
+   thread runner;
+} Worker;
+
+
 
 /* -- (Module) Global Variables ------------------------------------------- */
-static int ctrlC;
+static volatile sig_atomic_t ctrlC;
+static vector<Worker *> workers;
+static EventLoop * watcher; //event loop of the main thread, watching dynres.txt
+static shared_ptr<const RouteTable> routes; //index of dynamic resources, by URI (replaced as a whole, when dynres.txt is reloaded)
+static atomic<uint64_t> routesGeneration; //incremented, whenever routes are replaced
 static DynamicResource * code200;
 static DynamicResource * code404;
+static DynamicResource * code410;
+static DynamicResource * code413;
+static DynamicResource * code431;
+static DynamicResource * code503;
 static string htmlBasePath;
+static StaticCache * staticCache;
+static SnapshotStore * snapshotStore; //NULL, if dynamic resources are not persisted
+static size_t staticCacheSize = 64 * 1024 * 1024; //memory budget of the static file cache
+static size_t maxBodySize = 1024 * 1024; //max. size of POST content
+static uint64_t idleTimeout = 60000; //time in ms, after which idle (keep-alive) connections are closed
+static uint64_t headerTimeout = 10000; //time in ms, within which the header of a request must be received completely
+static uint64_t pollTimeout = 0; //time in ms, after which deferred requests are replied "304 Not Modified" (0: never)
+static size_t historyDepth = 0; //number of recent versions kept per dynamic resource (0: disabled)
+static size_t historyBudget = 1024 * 1024; //max. size of the versions kept per dynamic resource
+static size_t compressMinSize = 0; //dynamic content of at least that many bytes is compressed (0: disabled)
+static uint32_t maxConnections = 65536; //max. number of connections per worker
+static int backlog = SOMAXCONN; //max. number of connections waiting to be accepted (per worker)
+static int deferAccept = 0; //time in s, connections are held by the kernel until data is received (TCP_DEFER_ACCEPT; 0: disabled)
+static int fastOpen = 0; //max. number of pending TCP Fast Open requests (0: disabled)
+static size_t highWaterMark = 1024 * 1024; //no further requests of a connection are processed, while that many bytes are queued for sending
 
 /* -- Module Global Function Prototypes ----------------------------------- */
-static int m_serve_requests(Connection& connection, list<DynamicResource *>& dynamicResources);
-static int m_reply_dynamic_content(Connection& connection);
+static void m_load_resources(const string& filePath, unordered_map<string, DynamicResource *>& resources, unordered_map<string, TopicPattern *>& patterns);
+static void m_watch_resources(const string& filePath, unordered_map<string, DynamicResource *>& resources, unordered_map<string, TopicPattern *>& patterns);
+static void m_run_worker(Worker * worker);
+static int m_accept(Worker& worker, NbTcpConnection& connection);
+static bool m_shed_connection(Worker& worker);
+static void m_refresh_routes(Worker& worker);
+static int m_serve_requests(Connection& connection);
+static int m_process_requests(Worker& worker, Connection& connection, const RouteTable& routes);
+static int m_process_request(Worker& worker, Connection& connection, const RouteTable& routes, const char * request, const hqsp_request_t& parsed, const unsigned requestLen);
+static int m_process_frames(Connection& connection);
+static void m_send_close_frame(Connection& connection, uint16_t code);
+static int m_reply_dynamic_content(Worker& worker, Connection& connection);
+static int m_reply_stream(Worker& worker, Connection& connection);
+static void m_reply_history(Connection& connection, DynamicResource * resource);
+static RenderedContentPtr m_select_encoding(const RenderedContentPtr& rendered, unsigned encodings);
 static int m_reply_static_content(Connection& connection, const string& uri);
+static int m_flush_connection(Connection& connection);
+static void m_update_connection(Worker& worker, Connection& connection, int status);
+static void m_close_connection(Worker& worker, Connection& connection);
+static void m_update_timer(Worker& worker, Connection& connection);
+static void m_enable_probes(Connection& connection);
+static int m_expire_timers(Worker& worker, const RouteTable& routes);
+static int m_reply_not_modified(Worker& worker, Connection& connection);
+static bool m_is_keep_alive(const char * request, const hqsp_request_t& parsed);
+static bool m_has_token(const char * value, int valueLen, const char * token);
+static uint64_t m_now();
 static string m_get_content_type_by_uri(const string& uri, const string& fallback);
 
 
@@ -130,279 +403,1039 @@ static string m_get_content_type_by_uri(const string& uri, const string& fallbac
 void m_signal_handler(int a)
 {
    ctrlC = 1;
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      workers[i]->eventLoop->wakeup();
+   }
+   if (watcher != NULL)
+   {
+      watcher->wakeup();
+   }
 }
 
 
 int main(int argc, const char * argv[])
 {
-   list<DynamicResource *> dynamicResources;
-   list<Connection> connections;
-   list<Connection>::iterator conIt;
+   unordered_map<string, DynamicResource *> dynamicResources; //all resources ever listed in dynres.txt (incl. retired ones), by URI
+   unordered_map<string, TopicPattern *> topicPatterns; //all patterns ever listed in dynres.txt (incl. retired ones), by prefix
+   size_t maxTopics = 100000;
+   vector<const char *> arguments;
+   unsigned workerCount = 1;
+   DynamicResource::HashMode hashMode = DynamicResource::HASH_CRC32;
+   string snapshotPath;
    uint16_t port;
    int status;
 
+   //process command line options
+   for (int i = 1; i < argc; ++i)
+   {
+      if ((strcmp(argv[i], "--workers") == 0) && ((i + 1) < argc))
+      {
+         workerCount = (unsigned)atoi(argv[++i]);
+         if (workerCount < 1) workerCount = 1;
+         continue;
+      }
+      if ((strcmp(argv[i], "--max-body") == 0) && ((i + 1) < argc))
+      {
+         maxBodySize = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--history") == 0) && ((i + 1) < argc))
+      {
+         historyDepth = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--history-bytes") == 0) && ((i + 1) < argc))
+      {
+         historyBudget = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--max-topics") == 0) && ((i + 1) < argc))
+      {
+         maxTopics = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--snapshot") == 0) && ((i + 1) < argc))
+      {
+         snapshotPath = argv[++i];
+         continue;
+      }
+      if ((strcmp(argv[i], "--compress") == 0) && ((i + 1) < argc))
+      {
+         compressMinSize = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--content-hash") == 0) && ((i + 1) < argc))
+      {
+         if (strcmp(argv[++i], "version") == 0)
+         {
+            hashMode = DynamicResource::HASH_VERSION;
+         }
+         continue;
+      }
+      if ((strcmp(argv[i], "--static-cache") == 0) && ((i + 1) < argc))
+      {
+         staticCacheSize = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--high-water") == 0) && ((i + 1) < argc))
+      {
+         highWaterMark = (size_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--idle-timeout") == 0) && ((i + 1) < argc))
+      {
+         idleTimeout = 1000 * (uint64_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--max-connections") == 0) && ((i + 1) < argc))
+      {
+         maxConnections = (uint32_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--backlog") == 0) && ((i + 1) < argc))
+      {
+         backlog = atoi(argv[++i]);
+         continue;
+      }
+      if ((strcmp(argv[i], "--defer-accept") == 0) && ((i + 1) < argc))
+      {
+         deferAccept = atoi(argv[++i]);
+         continue;
+      }
+      if ((strcmp(argv[i], "--fastopen") == 0) && ((i + 1) < argc))
+      {
+         fastOpen = atoi(argv[++i]);
+         continue;
+      }
+      if ((strcmp(argv[i], "--header-timeout") == 0) && ((i + 1) < argc))
+      {
+         headerTimeout = 1000 * (uint64_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      if ((strcmp(argv[i], "--poll-timeout") == 0) && ((i + 1) < argc))
+      {
+         pollTimeout = 1000 * (uint64_t)strtoul(argv[++i], NULL, 10);
+         continue;
+      }
+      arguments.push_back(argv[i]);
+   }
+
    //process command line arguments
-   if (argc == 3)
+   if (arguments.size() == 2)
    {
-      htmlBasePath = argv[1];
-      port = (uint16_t)atoi(argv[2]);
+      htmlBasePath = arguments[0];
+      port = (uint16_t)atoi(arguments[1]);
    }
    else //otherwise: use defaults
    {
-      cout << "Usage: apoll [HTML-base-path] [TCP-port-number]" << endl;
+      cout << "Usage: apoll [HTML-base-path] [TCP-port-number] [--workers N] [--max-body BYTES] [--idle-timeout SECONDS] [--header-timeout SECONDS] [--poll-timeout SECONDS] [--max-connections N] [--backlog N] [--defer-accept SECONDS] [--fastopen N] [--static-cache BYTES] [--high-water BYTES] [--content-hash crc32|version] [--history N] [--history-bytes BYTES] [--compress BYTES] [--snapshot FILE] [--max-topics N]" << endl;
       htmlBasePath = "."; //"this" directory
       port = 8083; //default port
    }
 
 
+   //create workers, each with its own event loop
+   //their reply queues must be registered before any dynamic resource is created
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      Worker * worker = new Worker();
+      worker->eventLoop = new EventLoop();
+      status = worker->eventLoop->open();
+      if (status < 0)
+      {
+         return -1;
+      }
+      worker->replyQueue = new ReplyQueue(worker->eventLoop);
+      worker->timers = new TimerWheel(m_now());
+      worker->connections = new Slab<Connection>(maxConnections);
+      worker->reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+      DynamicResource::registerReplyQueue(worker->replyQueue);
+      workers.push_back(worker);
+   }
+
+   //create cache of static files (files larger than 1/8 of the budget are not cached)
+   staticCache = new StaticCache(staticCacheSize, staticCacheSize / 8);
+   if (staticCache->open() < 0)
+   {
+      cout << "Failed to watch static files; caching disabled" << endl;
+   }
+
+   //select how the Content-Hash of dynamic resources is derived, how many versions are kept and which are compressed (before any resource is created)
+   DynamicResource::setHashMode(hashMode);
+   DynamicResource::setHistoryLimits(historyDepth, historyBudget);
+   DynamicResource::setCompression(compressMinSize);
+
    //create default resources
    code200 = new DynamicResource("/200", "200 OK");
    code200->setContent("OK");
    code404 = new DynamicResource("/200", "404 Not Found");
    code404->setContent("Not Found");
-
-   //create dynamic resources, as specified in "dynres.txt"
-   const string filePath = htmlBasePath + "/dynres.txt";
-   ifstream file(filePath, ios::in);
-   if (file.is_open())
+   code410 = new DynamicResource("/410", "410 Gone");
+   code410->setContent("Gone");
+   code413 = new DynamicResource("/413", "413 Payload Too Large");
+   code413->setContent("Payload Too Large");
+   code431 = new DynamicResource("/431", "431 Request Header Fields Too Large");
+   code431->setContent("Request Header Fields Too Large");
+   code503 = new DynamicResource("/503", "503 Service Unavailable");
+   code503->setContent("Service Unavailable");
+
+   //open the store of persisted dynamic resources (the default resources above are not persisted)
+   if (!snapshotPath.empty())
    {
-      string uri;
-      //read out file, line by line
-      while (getline(file, uri))
+      if (snapshotPath[0] != '/')
       {
-         if (uri[0] == '/') //only those lines, that starts with a '/'
-         {
-            //add to list of dynamic resources
-            dynamicResources.push_back(new DynamicResource(uri));
-         }
+         snapshotPath = htmlBasePath + "/" + snapshotPath;
+      }
+      staticCache->hide(snapshotPath); //the snapshot (and its temporary file while compacting) is not served as static content
+      staticCache->hide(snapshotPath + ".tmp");
+      snapshotStore = new SnapshotStore();
+      if (snapshotStore->open(snapshotPath) < 0)
+      {
+         delete snapshotStore;
+         snapshotStore = NULL;
       }
-      file.close();
    }
 
+   //create dynamic resources, as specified in "dynres.txt"
+   //their last versions are restored from the snapshot (if any)
+   TopicPattern::setLimit(maxTopics);
+   TopicPattern::setSnapshot(snapshotStore);
+   const string filePath = htmlBasePath + "/dynres.txt";
+   m_load_resources(filePath, dynamicResources, topicPatterns);
+
 
-   //create server
-   NbTcpServer * tcpServer = new NbTcpServer();
-   status = tcpServer->open(port);
-   if (status < 0)
+   //create servers; the kernel distributes incomming connections among the workers
+   for (unsigned i = 0; i < workerCount; ++i)
    {
-      cout << "Failed to open server on port " << port << endl;
-      return -1;
+      Worker * worker = workers[i];
+      worker->tcpServer = new NbTcpServer();
+      status = worker->tcpServer->open(port, (workerCount > 1), backlog);
+      if (status < 0)
+      {
+         cout << "Failed to open server on port " << port << endl;
+         return -1;
+      }
+      if ((deferAccept > 0) && (worker->tcpServer->setDeferAccept(deferAccept) < 0))
+      {
+         cout << "Failed to enable TCP_DEFER_ACCEPT" << endl;
+      }
+      if ((fastOpen > 0) && (worker->tcpServer->setFastOpen(fastOpen) < 0))
+      {
+         cout << "Failed to enable TCP_FASTOPEN" << endl;
+      }
+      worker->eventLoop->add(worker->tcpServer->getSocket(), EPOLLIN | EPOLLET, worker->tcpServer);
+      staticCache->attach(*worker->eventLoop);
    }
    cout << "Running webserver on port: " << port << endl;
    cout << "HTML base path: " << htmlBasePath << endl;
+   cout << "Worker threads: " << workerCount << endl;
    cout << "Use CTRL+C to quit!" << endl;
 
 
    //register signal handler, to quit program usin CTRL+C
    signal(SIGINT, &m_signal_handler);
+   //peers may reset connections while a file is streamed by sendfile (which, unlike sendmsg, has no MSG_NOSIGNAL)
+   signal(SIGPIPE, SIG_IGN);
 
-   //enter super-loop
-   while (!ctrlC)
+   //run workers
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      workers[i]->runner = thread(m_run_worker, workers[i]);
+   }
+   m_watch_resources(filePath, dynamicResources, topicPatterns); //until CTRL+C
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      workers[i]->runner.join();
+   }
+
+
+   //shutdown workers
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      Worker * worker = workers[i];
+
+      //shutdown server
+      worker->tcpServer->close();
+      delete worker->tcpServer;
+
+      //close still open connections
+      for (uint32_t j = 0; j < worker->connections->getActiveCount(); ++j)
+      {
+         (*worker->connections)[worker->connections->getActive(j)].connection.close();
+      }
+      worker->eventLoop->close();
+   }
+
+
+   //delete dynamic resources
+   routes.reset();
+   for (unordered_map<string, DynamicResource *>::iterator it = dynamicResources.begin(); it != dynamicResources.end(); ++it)
+   {
+      delete it->second;
+   }
+   for (unordered_map<string, TopicPattern *>::iterator it = topicPatterns.begin(); it != topicPatterns.end(); ++it)
    {
-      Connection con;
+      delete it->second; //(incl. the resources created by it)
+   }
+   delete staticCache;
+   delete snapshotStore;
+   delete code503;
+   delete code431;
+   delete code413;
+   delete code410;
+   delete code404;
+   delete code200;
 
-      //push new tcp connections to "connection list"
-      con.connection = tcpServer->serve();
-      if (con.connection)
+   //delete workers
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      delete workers[i]->replyQueue;
+      delete workers[i]->timers;
+      delete workers[i]->connections;
+      delete workers[i]->eventLoop;
+      if (workers[i]->reserveFd >= 0)
       {
-         //add to this connection to the list of active connections
-         con.resource = NULL;
-         con.hash = 0;
-         connections.push_back(con);
+         ::close(workers[i]->reserveFd);
       }
+      delete workers[i];
+   }
+   workers.clear();
+
+
+   return 0;
+}
+
 
 
-      //for each connection ...
-      //receive HTTP requests
-      conIt = connections.begin();
-      while (conIt != connections.end())
+//(re)load dynres.txt and publish the resulting routes to all workers
+//listed URIs, that are new, become resources (their last versions are restored from the snapshot, if any)
+//resources, that are listed no more, are retired (their waiters are replied "410 Gone"). others are kept as they are
+static void m_load_resources(const string& filePath, unordered_map<string, DynamicResource *>& resources, unordered_map<string, TopicPattern *>& patterns)
+{
+   ifstream file(filePath, ios::in);
+   if (!file.is_open())
+   {
+      if (!atomic_load(&routes)) //no resources at all
+      {
+         atomic_store(&routes, shared_ptr<const RouteTable>(make_shared<RouteTable>()));
+      }
+      return;
+   }
+
+   //read out file, line by line
+   shared_ptr<RouteTable> table = make_shared<RouteTable>();
+   unordered_set<TopicPattern *> listed;
+   size_t added = 0;
+   string uri;
+   while (getline(file, uri))
+   {
+      if ((uri[0] == '/') && (uri[uri.length() - 1] == '*')) //pattern
       {
-         status = m_serve_requests(*conIt, dynamicResources);
-         if (status != 0) //close connection
+         const string prefix = uri.substr(0, uri.length() - 1);
+         TopicPattern * pattern = patterns[prefix];
+         if (pattern == NULL)
          {
-            //close that connection
-            conIt->connection->close();
-            delete conIt->connection;
-            //remove from list of active connections
-            conIt = connections.erase(conIt);
-            continue;
+            pattern = new TopicPattern(prefix);
+            patterns[prefix] = pattern;
+         }
+         else if (pattern->isRetired())
+         {
+            pattern->revive();
          }
-         conIt++;
+         table->insert(pattern);
+         listed.insert(pattern);
+         continue;
       }
+      if (uri[0] == '/') //only those lines, that starts with a '/'
+      {
+         DynamicResource * res = resources[uri];
+         if (res == NULL) //new resource
+         {
+            res = new DynamicResource(uri);
+            resources[uri] = res;
+            if (snapshotStore != NULL)
+            {
+               res->setSnapshot(snapshotStore);
+            }
+            added++;
+         }
+         else if (res->isRetired()) //listed again
+         {
+            res->revive();
+            if (snapshotStore != NULL)
+            {
+               res->setSnapshot(snapshotStore);
+            }
+            added++;
+         }
+         table->insert(res); //(duplicate URIs are ignored)
+      }
+   }
+   file.close();
+
+   //publish routes; workers switch to them with the next event
+   atomic_store(&routes, shared_ptr<const RouteTable>(table));
+   routesGeneration++;
+
+   //retire resources, that are listed no more
+   size_t removed = 0;
+   for (unordered_map<string, DynamicResource *>::iterator it = resources.begin(); it != resources.end(); ++it)
+   {
+      if ((table->findExact(it->first.c_str(), it->first.length()) == NULL) && !it->second->isRetired())
+      {
+         it->second->retire();
+         removed++;
+      }
+   }
+   for (unordered_map<string, TopicPattern *>::iterator it = patterns.begin(); it != patterns.end(); ++it)
+   {
+      if ((listed.count(it->second) == 0) && !it->second->isRetired())
+      {
+         it->second->retire();
+      }
+   }
+   cout << "Dynamic resources: " << table->size() << " (" << added << " added, " << removed << " removed), patterns: " << listed.size() << endl;
+}
+
 
+//reload dynres.txt whenever it was written or replaced (e.g. renamed into place by an editor)
+//and compact the snapshot, when it is due (once per second)
+//returns on CTRL+C. the workers keep on serving while the file is reloaded, or the snapshot is compacted
+static void m_watch_resources(const string& filePath, unordered_map<string, DynamicResource *>& resources, unordered_map<string, TopicPattern *>& patterns)
+{
+   EventLoop eventLoop;
+   struct epoll_event events[4];
+   char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+   if (eventLoop.open() < 0)
+   {
+      return;
+   }
+   int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if ((fd < 0) || (inotify_add_watch(fd, htmlBasePath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) ||
+       (eventLoop.add(fd, EPOLLIN | EPOLLET, NULL) < 0))
+   {
+      cout << "Failed to watch dynres.txt; reload disabled" << endl;
+      if (fd >= 0)
+      {
+         close(fd);
+         fd = -1;
+      }
+      if (snapshotStore == NULL)
+      {
+         return;
+      }
+   }
+   watcher = &eventLoop;
 
-      //for each connection ...
-      //reply dynamic content
-      conIt = connections.begin();
-      while (conIt != connections.end())
+   while (!ctrlC)
+   {
+      if (eventLoop.wait(events, 4, (snapshotStore != NULL) ? 1000 : -1) < 0)
       {
-         status = m_reply_dynamic_content(*conIt);
-         if (status != 0) //close connection
+         break;
+      }
+      eventLoop.acknowledge(); //(woken up by CTRL+C)
+      bool changed = false;
+      ssize_t len;
+      while ((fd >= 0) && ((len = read(fd, buffer, sizeof(buffer))) > 0))
+      {
+         for (char * p = buffer; p < (buffer + len); p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
          {
-            //close that connection
-            conIt->connection->close();
-            delete conIt->connection;
-            //remove from list of active connections
-            conIt = connections.erase(conIt);
-            continue;
+            const struct inotify_event * event = (const struct inotify_event *)p;
+            changed |= ((event->len > 0) && (strcmp(event->name, "dynres.txt") == 0));
          }
-         conIt++;
       }
+      if (changed)
+      {
+         m_load_resources(filePath, resources, patterns);
+      }
+      if (snapshotStore != NULL)
+      {
+         snapshotStore->compact();
+      }
+   }
+   watcher = NULL;
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+}
+
 
-      //
-      usleep(50000); //50ms
+//switch to the latest routes, if they were replaced (the previous ones are released by the last worker using them)
+static void m_refresh_routes(Worker& worker)
+{
+   const uint64_t generation = routesGeneration;
+   if (worker.routesGeneration != generation)
+   {
+      worker.routes = atomic_load(&routes);
+      worker.routesGeneration = generation;
    }
+}
 
 
-   //shutdown server
-   tcpServer->close();
-   delete tcpServer;
+//event loop of a worker thread
+static void m_run_worker(Worker * worker)
+{
+   EventLoop * eventLoop = worker->eventLoop;
+   NbTcpServer * tcpServer = worker->tcpServer;
+   struct epoll_event events[MAX_EVENTS];
+   int status;
 
-   //delete still open connections
-   conIt = connections.begin();
-   while (conIt != connections.end())
+   m_refresh_routes(*worker);
+   while (!ctrlC)
    {
-      conIt->connection->close();
-      delete conIt->connection;
-      conIt++;
+      WaiterList changed;
+      int timeout;
+      int count;
+
+      //handle timeouts of connections; sleep until something happens (or the next timer expires)
+      timeout = m_expire_timers(*worker, *worker->routes);
+      count = eventLoop->wait(events, MAX_EVENTS, timeout);
+      m_refresh_routes(*worker);
+      for (int i = 0; i < count; ++i)
+      {
+         void * context = events[i].data.ptr;
+
+         //server socket is readable
+         if (context == tcpServer)
+         {
+            //accept all pending tcp connections (edge-triggered!)
+            //and add them to the set of active connections
+            while (1)
+            {
+               const uint32_t slot = worker->connections->acquire();
+               if (slot == Slab<Connection>::NONE) //too many connections -> refuse pending ones
+               {
+                  NbTcpConnection refused;
+                  if (m_accept(*worker, refused) < 0)
+                  {
+                     break;
+                  }
+                  continue; //closed by destructor
+               }
+               Connection& con = (*worker->connections)[slot];
+               const int sock = m_accept(*worker, con.connection);
+               if (sock < 0)
+               {
+                  worker->connections->release(slot);
+                  break;
+               }
+               con.slot = slot;
+               con.resource = NULL;
+               con.hash = 0;
+               con.batch = false;
+               con.delta = false;
+               con.stream = false;
+               con.streaming = false;
+               con.websocket = false;
+               con.messageOpcode = WebSocket::CONTINUATION;
+               con.keepAlive = false;
+               con.closing = false;
+               WaiterList::init(&con.waiter, &con);
+               TimerWheel::init(&con.timer, &con);
+               con.timeout = TIMEOUT_NONE;
+               con.probed = false;
+               m_update_timer(*worker, con);
+               eventLoop->add(sock, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, &con);
+            }
+            continue;
+         }
+
+         //static files have changed
+         if (context == staticCache)
+         {
+            staticCache->processEvents();
+            continue;
+         }
+
+         //content of a dynamic resource has changed (or shutdown requested)
+         if (context == eventLoop)
+         {
+            eventLoop->acknowledge(); //deferred requests are replied after all events are processed
+            continue;
+         }
+
+         //connection is writable: send queued data
+         Connection& con = *(Connection *)context;
+         status = 0;
+         if (events[i].events & EPOLLOUT)
+         {
+            status = m_flush_connection(con);
+            if ((status == 0) && con.stream) //continue a paused event stream
+            {
+               status = m_reply_dynamic_content(*worker, con);
+            }
+         }
+
+         //connection is readable
+         //receive HTTP requests and reply immediately, when possible
+         if ((status == 0) && (events[i].events & ~EPOLLOUT))
+         {
+            status = m_serve_requests(con);
+         }
+         if (status == 0)
+         {
+            status = m_process_requests(*worker, con, *worker->routes);
+         }
+         m_update_connection(*worker, con, status); //close connection, if required
+      }
+
+      //for each deferred request, whose resource has changed ...
+      //reply dynamic content, then continue with requests pipelined behind it
+      Waiter * waiter;
+      worker->replyQueue->takeAll(changed);
+      while ((waiter = changed.pop()) != NULL)
+      {
+         Connection& con = *(Connection *)waiter->context;
+         status = m_reply_dynamic_content(*worker, con);
+         if (status == 0)
+         {
+            status = m_process_requests(*worker, con, *worker->routes);
+         }
+         m_update_connection(*worker, con, status); //close connection, if required
+      }
    }
+}
 
 
-   //delete dynamic resources
-   list<DynamicResource *>::iterator resIt = dynamicResources.begin();
-   while (resIt != dynamicResources.end()) //find requested resource
+//accept a pending connection into the given (closed) connection object
+//connections, that failed while pending (e.g. reset by the client), are skipped
+//returns socket of the accepted connection; -1 if no connection is pending anymore (EAGAIN) or accepting fails
+static int m_accept(Worker& worker, NbTcpConnection& connection)
+{
+   while (1)
    {
-      DynamicResource * res = *resIt++;
-      delete res;
+      const int sock = worker.tcpServer->serve(connection);
+      if (sock >= 0)
+      {
+         return sock;
+      }
+      switch (errno)
+      {
+         case EINTR:
+         case ECONNABORTED:
+         case EPROTO:
+         case EPERM: //(refused by firewall rules)
+            continue;
+
+         case EMFILE: //out of file descriptors -> shed the pending connection (it would never be reported again, edge-triggered!)
+         case ENFILE:
+            if (m_shed_connection(worker))
+            {
+               continue;
+            }
+            return -1;
+
+         default: //EAGAIN/EWOULDBLOCK: all pending connections were accepted
+            return -1;
+      }
    }
-   delete code404;
-   delete code200;
+}
 
 
-   return 0;
+//release the reserve file descriptor, accept the next pending connection and close it immediately, reserve again
+//returns true, if further pending connections may be shed this way
+static bool m_shed_connection(Worker& worker)
+{
+   int error = EMFILE;
+   if (worker.reserveFd < 0)
+   {
+      return false;
+   }
+   ::close(worker.reserveFd);
+   {
+      NbTcpConnection refused; //closed by destructor
+      if (worker.tcpServer->serve(refused) >= 0)
+      {
+         error = 0;
+      }
+      else
+      {
+         error = errno;
+      }
+   }
+   worker.reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+   return ((error == 0) || (error == EINTR) || (error == ECONNABORTED)); //(the descriptor may have been taken by another worker)
 }
 
 
 
+//receive all available data into the request buffer of the connection
 //return 0 when connection stays open
 //return -1 when connection was closed remotely
 //return 1 when connection shall be closed
-static int m_serve_requests(Connection& connection, list<DynamicResource *>& dynamicResources)
+static int m_serve_requests(Connection& connection)
 {
-   uint8_t buffer[4096];
+   RequestBuffer& request = connection.request;
    int status;
 
-   //check for incomming data
-   status = connection.connection->recv(buffer, sizeof(buffer) - 1);
+   //receive until the socket is drained (required for edge-triggered notifications)
+   while (1)
+   {
+      //check for incomming data
+      status = connection.connection.recv(request.reserve(RECV_CHUNK_SIZE), RECV_CHUNK_SIZE);
 
-   //connection closed ?
-   if (status < 0)
+      //connection closed ?
+      if (status < 0)
+      {
+         //connection was closed remotely
+         return -1;
+      }
+
+      //nothing (more) received
+      if (status == 0)
+      {
+         return 0;
+      }
+
+      //otherwise - data received
+      request.commit((size_t)status);
+
+      //limit the amount of data, pipelined behind a pending request
+      if (request.length() > (MAX_HEADER_SIZE + maxBodySize + RECV_CHUNK_SIZE))
+      {
+         return 1;
+      }
+   }
+}
+
+
+//process the buffered requests of a connection, in order
+//a request is processed once it is complete and all preceding requests have been replied
+//return 0 when connection stays open
+//return 1 when connection shall be closed
+static int m_process_requests(Worker& worker, Connection& connection, const RouteTable& routes)
+{
+   RequestBuffer& request = connection.request;
+   int status;
+
+   //until a request is deferred, or too much data is queued for sending (backpressure for slow readers)
+   while ((connection.resource == NULL) && !connection.closing && (connection.connection.getPending() < highWaterMark))
    {
-      //connection was closed remotely
-      return -1;
+      //requests may be split into several segments. process it, once it is complete
+      long requestLen = request.check(MAX_HEADER_SIZE, maxBodySize);
+      if (requestLen == RequestBuffer::INCOMPLETE)
+      {
+         return 0;
+      }
+      if (requestLen < 0) //request exceeds limits -> reply error and close connection
+      {
+         connection.resource = (requestLen == RequestBuffer::BODY_TOO_LARGE) ? code413 : code431;
+         connection.hash = 0;
+         connection.keepAlive = false;
+         return m_reply_dynamic_content(worker, connection);
+      }
+
+      //add termination, just to be safe
+      uint8_t * buffer = (uint8_t *)request.data();
+      const uint8_t saved = buffer[requestLen];
+      buffer[requestLen] = 0;
+      status = m_process_request(worker, connection, routes, (const char *)buffer, request.header(), (unsigned)requestLen);
+      buffer[requestLen] = saved;
+      request.consume((size_t)requestLen);
+      if (status != 0)
+      {
+         return status;
+      }
+
+      //reply immediately, when possible. otherwise the request is deferred
+      status = m_reply_dynamic_content(worker, connection);
+      if (status != 0)
+      {
+         return status;
+      }
+   }
+
+   //a request may have upgraded the connection -> continue with the WebSocket frames behind it
+   if (connection.websocket)
+   {
+      return m_process_frames(connection);
    }
+   return 0;
+}
+
+
+//process the buffered WebSocket frames of a connection, in order
+//text and binary messages are published as new content of the resource, the connection was upgraded on
+//return 0 when connection stays open
+//return 1 when connection shall be closed
+static int m_process_frames(Connection& connection)
+{
+   RequestBuffer& request = connection.request;
+   WebSocketFrame frame;
 
-   //nothing received
-   if (status == 0)
+   //until too much data is queued for sending (pongs; backpressure for slow readers)
+   while (!connection.closing && (connection.connection.getPending() < highWaterMark))
    {
-      return 0;
+      long frameLen = WebSocket::decode((uint8_t *)request.data(), request.length(), maxBodySize, frame);
+      if (frameLen == WebSocket::INCOMPLETE)
+      {
+         return 0;
+      }
+      if (frameLen < 0)
+      {
+         m_send_close_frame(connection, (frameLen == WebSocket::MESSAGE_TOO_LARGE) ? WebSocket::CLOSE_TOO_LARGE : WebSocket::CLOSE_PROTOCOL_ERROR);
+         return 1;
+      }
+
+      switch (frame.opcode)
+      {
+         case WebSocket::PING:
+         {
+            string pong = WebSocket::encodeHeader(WebSocket::PONG, frame.length);
+            pong.append((const char *)frame.payload, frame.length);
+            connection.connection.send((const uint8_t *)pong.data(), pong.length());
+            break;
+         }
+
+         case WebSocket::PONG:
+            break;
+
+         case WebSocket::CLOSE:
+         {
+            //echo status code of the client
+            const uint16_t code = (frame.length >= 2) ? (uint16_t)((frame.payload[0] << 8) | frame.payload[1]) : (uint16_t)WebSocket::CLOSE_NORMAL;
+            m_send_close_frame(connection, code);
+            return 1;
+         }
+
+         default: //data frames
+         {
+            //continuation frames are only valid within a fragmented message (and vice versa)
+            if ((frame.opcode == WebSocket::CONTINUATION) == (connection.messageOpcode == WebSocket::CONTINUATION))
+            {
+               m_send_close_frame(connection, WebSocket::CLOSE_PROTOCOL_ERROR);
+               return 1;
+            }
+            if ((connection.message.length() + frame.length) > maxBodySize)
+            {
+               m_send_close_frame(connection, WebSocket::CLOSE_TOO_LARGE);
+               return 1;
+            }
+            if (frame.fin && (connection.messageOpcode == WebSocket::CONTINUATION)) //unfragmented message
+            {
+               connection.resource->setContent(string((const char *)frame.payload, frame.length)); //notifies all subscribers (including this one)
+               break;
+            }
+            connection.message.append((const char *)frame.payload, frame.length);
+            connection.messageOpcode = (frame.opcode == WebSocket::CONTINUATION) ? connection.messageOpcode : frame.opcode;
+            if (frame.fin)
+            {
+               connection.resource->setContent(connection.message);
+               string().swap(connection.message); //release memory
+               connection.messageOpcode = WebSocket::CONTINUATION;
+            }
+            break;
+         }
+      }
+      request.consume((size_t)frameLen);
    }
+   return 0;
+}
+
+
+//send a close frame with the given status code (the connection is closed, once it was sent)
+static void m_send_close_frame(Connection& connection, uint16_t code)
+{
+   string close = WebSocket::encodeHeader(WebSocket::CLOSE, 2);
+   close += (char)(code >> 8);
+   close += (char)code;
+   connection.connection.send((const uint8_t *)close.data(), close.length());
+}
+
+
+//return 0 when connection stays open
+//return 1 when connection shall be closed
+static int m_process_request(Worker& worker, Connection& connection, const RouteTable& routes, const char * request, const hqsp_request_t& parsed, const unsigned requestLen)
+{
+   int status;
 
-   //otherwise - data received
-   const unsigned requestLen = (unsigned)status;
    const char * resource;
    int resourceLen;
    bool isGET;
    bool isPOST;
 
    //invalidate earlier requests
+   DynamicResource::removeWaiter(*worker.replyQueue, &connection.waiter);
    connection.resource = NULL;
    connection.hash = 0;
+   connection.batch = false;
+   connection.delta = false;
+   connection.stream = false;
+   connection.keepAlive = m_is_keep_alive(request, parsed);
+   connection.encodings = 0;
+
+   //the request was tokenized by the request buffer. get fields without rescanning the request
+   resource = &request[parsed.resource.offset];
+   resourceLen = (int)parsed.resource.length;
+   if ((resourceLen == 1) && (resource[0] == '/')) //redirect to default page
+   {
+      resource = "/index.html";
+      resourceLen = 11;
+   }
 
-   //parse http request
-   buffer[requestLen] = 0; //add termination, just to be safe
-   resourceLen = hqsp_get_resource((const char *)buffer, &resource);
-   string uri(resource, resourceLen); //uri: resoure as std::stirng
-   if (uri == "/") uri = "/index.html"; //redirect to default page
+   //look up dynamic resource, directly from the request buffer
+   DynamicResource * res = routes.find(resource, resourceLen);
 
 
    //GET
-   isGET = hqsp_is_method_get((const char *)buffer);
+   isGET = hqsp_view_equals(request, parsed.method, "GET");
    if (isGET)
    {
-      //check if the requested resource is static content
-      status = m_reply_static_content(connection, uri);
-      if (status != 0) //yes it is ...
+      //clients may accept compressed replies (precompressed static files; dynamic content compressed once per version)
+      const char * encoding;
+      int encodingLen = hqsp_get_parsed_header_value(request, &parsed, "Accept-Encoding", &encoding);
+      if (encodingLen > 0)
+      {
+         connection.encodings = Compression::parseAcceptEncoding(encoding, encodingLen);
+      }
+
+      //check if the requested resource is static content (unless it is a dynamic resource, that was already found.
+      //thus long polling doesn't touch the static cache and the file system)
+      if (res == NULL)
       {
-         return status; //instruct caller to close connection
+         string uri(resource, resourceLen); //uri: resoure as std::stirng
+         status = m_reply_static_content(connection, uri);
+         if (status != 0) //yes it is ...
+         {
+            return (connection.keepAlive ? 0 : 1); //instruct caller to close connection, if required
+         }
       }
 
       //otherwise
       //check if the requested resource is dynamic content
-      list<DynamicResource *>::iterator resIt = dynamicResources.begin();
-      while (resIt != dynamicResources.end()) //find requested resource
+      if (res != NULL)
       {
-         DynamicResource * res = *resIt++;
-         if (res->uri == uri)
+         uint64_t contentHash = 0;
+         const char * header;
+         int headerLen;
+
+         //clients may use long polling to get content
+         //for the purpose of long polling, they may send a hash value for the already known content of a resource
+         //by means of that hash value the server can decides weather new data must be sent to the server immediatly or on change
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "Content-Hash", &header);
+         if (headerLen > 0)
+         {
+            contentHash = (uint64_t)strtoull(header, NULL, 10);
+         }
+
+         //clients may ask for all versions newer than the known one at once (catch-up after a burst of updates)
+         //they are replied as multipart message, if a history is kept
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "Accept", &header);
+         if ((contentHash != 0) && (headerLen > 0) && (DynamicResource::getHistoryDepth() > 0))
+         {
+            connection.batch = (string(header, headerLen).find("multipart/mixed") != string::npos);
+         }
+
+         //clients, still having the known version, may ask for a delta instead of the whole content (RFC 3229)
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "A-IM", &header);
+         if ((contentHash != 0) && (headerLen > 0) && (DynamicResource::getHistoryDepth() > 0))
+         {
+            connection.delta = (string(header, headerLen).find("apoll-delta") != string::npos);
+         }
+
+         //clients may subscribe to the resource as stream of server-sent events (instead of long polling)
+         //a reconnecting client continues with the versions following the last event it has received
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "Accept", &header);
+         if ((headerLen > 0) && (string(header, headerLen).find("text/event-stream") != string::npos))
+         {
+            headerLen = hqsp_get_parsed_header_value(request, &parsed, "Last-Event-ID", &header);
+            contentHash = (headerLen > 0) ? (uint64_t)strtoull(header, NULL, 10) : 0;
+            connection.stream = true;
+            connection.keepAlive = false; //the stream ends with the connection
+         }
+
+         //clients may upgrade the connection to the WebSocket protocol, to publish and subscribe on one connection
+         //versions are streamed as frames (starting with the one following Content-Hash); messages are published
+         //(only version 13 of the protocol is supported; other handshakes are rejected and the connection is closed)
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "Upgrade", &header);
+         if ((headerLen == 9) && (strncasecmp(header, "websocket", 9) == 0))
          {
-            uint32_t contentHash = 0;
-            const char * header;
-            int headerLen;
-
-            //clients may use long polling to get content
-            //for the purpose of long polling, they may send a hash value for the already known content of a resource
-            //by means of that hash value the server can decides weather new data must be sent to the server immediatly or on change
-            headerLen = hqsp_get_header_value((const char *)buffer, "Content-Hash", &header);
-            if (headerLen > 0)
+            static const char code426[] = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            static const char code400[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            headerLen = hqsp_get_parsed_header_value(request, &parsed, "Sec-WebSocket-Version", &header);
+            if ((headerLen != 2) || (strncmp(header, "13", 2) != 0))
             {
-               contentHash = (uint32_t)strtoul(header, NULL, 10);
+               connection.connection.send((const uint8_t *)code426, sizeof(code426) - 1);
+               return 1;
             }
-
-            //link resource request to connection
-            connection.resource = res;
-            connection.hash = contentHash;
-            return 0;
+            headerLen = hqsp_get_parsed_header_value(request, &parsed, "Connection", &header);
+            if (!m_has_token(header, headerLen, "upgrade"))
+            {
+               connection.connection.send((const uint8_t *)code400, sizeof(code400) - 1);
+               return 1;
+            }
+            headerLen = hqsp_get_parsed_header_value(request, &parsed, "Sec-WebSocket-Key", &header);
+            if (headerLen <= 0)
+            {
+               connection.connection.send((const uint8_t *)code400, sizeof(code400) - 1);
+               return 1;
+            }
+            //(sent at once, not held back for the frames - the client may be up to date)
+            string reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n";
+            reply += "Sec-WebSocket-Accept: " + WebSocket::getAcceptKey(header, headerLen) + "\r\n\r\n";
+            connection.connection.send((const uint8_t *)reply.data(), reply.length());
+            connection.stream = true;
+            connection.streaming = true;
+            connection.websocket = true;
+            connection.keepAlive = false;
          }
+
+         //link resource request to connection
+         connection.resource = res;
+         connection.hash = contentHash;
+         return 0;
       }
    }
 
 
    //POST
-   isPOST = hqsp_is_method_post((const char *)buffer);
+   isPOST = hqsp_view_equals(request, parsed.method, "POST");
    if (isPOST)
    {
       //POST can only deal with dynamic content
-      //find requested res
-      list<DynamicResource *>::iterator resIt = dynamicResources.begin();
-      while (resIt != dynamicResources.end())
+      //resources of URIs matching a pattern are created by their first POST (up to --max-topics)
+      TopicPattern * pattern = (res == NULL) ? routes.match(resource, resourceLen) : NULL;
+      if (pattern != NULL)
       {
-         DynamicResource * res = *resIt++;
-         if (res->uri == uri)
+         res = pattern->get(resource, resourceLen, true);
+         if (res == NULL)
          {
-            const char * header;
-            int headerLen;
-            const char * postContent;
-            int postContentLen;
-
-            //get content type from HTML header -> set
-            headerLen = hqsp_get_header_value((const char *)buffer, "Content-Type", &header);
-            if (headerLen > 0)
-            {
-               string contentType(header, headerLen);
-               res->contentType = contentType;
-            }
-
-            //get content that is sent via POST -> set
-            postContentLen = hqsp_get_post_content((const char *)buffer, requestLen, &postContent);
-            string content(postContent, postContentLen);
-            res->setContent(content);
-
-            //link resource "200 OK" to that connection in order to "acknowledge" the POST request
-            connection.resource = code200;
+            connection.resource = pattern->isRetired() ? code410 : code503;
             connection.hash = 0;
             return 0;
          }
       }
+      if ((res != NULL) && res->isRetired()) //removed from dynres.txt (its content can't be set any more)
+      {
+         connection.resource = code410;
+         connection.hash = 0;
+         return 0;
+      }
+      if (res != NULL)
+      {
+         const char * header;
+         int headerLen;
+
+         //get content type from HTML header -> set
+         headerLen = hqsp_get_parsed_header_value(request, &parsed, "Content-Type", &header);
+         if (headerLen > 0)
+         {
+            string contentType(header, headerLen);
+            res->setContentType(contentType);
+         }
+
+         //get content that is sent via POST -> set
+         string content(&request[parsed.headerLength], requestLen - parsed.headerLength);
+         res->setContent(content); //notifies deferred requests (of all workers)
+
+         //link resource "200 OK" to that connection in order to "acknowledge" the POST request
+         connection.resource = code200;
+         connection.hash = 0;
+         return 0;
+      }
    }
 
 
@@ -417,32 +1450,52 @@ static int m_serve_requests(Connection& connection, list<DynamicResource *>& dyn
 
 //return 0 when connection stays open
 //return 1 when connection shall be closed
-static int m_reply_dynamic_content(Connection& connection)
+static int m_reply_dynamic_content(Worker& worker, Connection& connection)
 {
    DynamicResource * resource = connection.resource;
+   if ((resource != NULL) && connection.stream)
+   {
+      return m_reply_stream(worker, connection);
+   }
    if (resource != NULL)
    {
       //check if client needs to informed about modified content
-      if (resource->hash != connection.hash)
+      //otherwise: park request until the content of the resource changes
+      bool parked = resource->addWaiter(*worker.replyQueue, &connection.waiter, connection.hash);
+      if (!parked)
       {
-         const string& content = resource->content;
-         string header;
-
          //update client ...
-         //send header
-         header  = "HTTP/1.1 " + resource->statusCode + "\r\n";
-         header += "Content-Type: " + resource->contentType + "\r\n";
-         header += "Content-Hash: " + to_string(resource->hash) + "\r\n";
-         header += "Content-Length: " + to_string(content.length()) + "\r\n";
-         header += "\r\n";
-         connection.connection->send((const uint8_t *)header.c_str(), header.length(), true);
-         //send content
-         connection.connection->send((const uint8_t *)content.c_str(), content.length());
+         if (connection.batch)
+         {
+            m_reply_history(connection, resource);
+         }
+         else
+         {
+            //the reply is rendered once per content version and shared by all clients (it is referenced, not copied,
+            //if it can't be sent immediately). header and content are sent at once
+            //deltas are rendered once per base version. the whole content is sent, if there is no (useful) delta
+            RenderedContentPtr rendered = connection.delta ? resource->getDelta(connection.hash) : RenderedContentPtr();
+            if (!rendered)
+            {
+               rendered = resource->getContent();
+               rendered = m_select_encoding(rendered, connection.encodings);
+            }
+            const string& header = rendered->header[connection.keepAlive ? 1 : 0];
+            struct iovec iov[2];
+            iov[0].iov_base = (void *)header.c_str();
+            iov[0].iov_len = header.length();
+            iov[1].iov_base = (void *)rendered->content.c_str();
+            iov[1].iov_len = rendered->content.length();
+            connection.connection.send(rendered, iov, 2);
+         }
 
          //invalidate request
          connection.resource = NULL;
          connection.hash = 0;
-         return 1; //instruct to close connection
+         connection.batch = false;
+         connection.delta = false;
+         m_update_timer(worker, connection); //connection is idle again
+         return (connection.keepAlive ? 0 : 1); //instruct to close connection, if required
       }
    }
 
@@ -451,44 +1504,387 @@ static int m_reply_dynamic_content(Connection& connection)
 }
 
 
+//send all versions of the resource, newer than the last one sent, as server-sent events (id: Content-Hash)
+//or as WebSocket frames (on upgraded connections)
+//the request stays linked to the connection, and is parked again after each update
+//slow clients: no events are sent, while too much data is queued. the stream continues, when the connection is
+//writable again, with the versions missed meanwhile (as far as they are within the history)
 //return 0 when connection stays open
 //return 1 when connection shall be closed
+static int m_reply_stream(Worker& worker, Connection& connection)
+{
+   static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+   DynamicResource * resource = connection.resource;
+   vector<RenderedContentPtr> versions;
+
+   if (!connection.streaming)
+   {
+      //sent at once (not held back by MSG_MORE), as no event may follow before the next update
+      connection.connection.send((const uint8_t *)header, sizeof(header) - 1);
+      connection.streaming = true;
+   }
+
+   while (!connection.closing && (connection.connection.getPending() < highWaterMark)) //nothing follows a close frame
+   {
+      if (resource->isRetired()) //end the stream (the resource was removed)
+      {
+         if (connection.websocket)
+         {
+            m_send_close_frame(connection, WebSocket::CLOSE_GOING_AWAY);
+         }
+         return 1;
+      }
+      if (resource->addWaiter(*worker.replyQueue, &connection.waiter, connection.hash))
+      {
+         return 0; //client is up to date -> wait for the next update
+      }
+      resource->getHistory(connection.hash, versions);
+      for (size_t i = 0; i < versions.size(); ++i)
+      {
+         if (connection.websocket)
+         {
+            //frame header and content are sent at once
+            struct iovec iov[2];
+            iov[0].iov_base = (void *)versions[i]->frame.c_str();
+            iov[0].iov_len = versions[i]->frame.length();
+            iov[1].iov_base = (void *)versions[i]->content.c_str();
+            iov[1].iov_len = versions[i]->content.length();
+            connection.connection.send(versions[i], iov, 2);
+            continue;
+         }
+         RenderedContentPtr event = resource->getEvent(versions[i]);
+         connection.connection.send(event, (const uint8_t *)event->content.c_str(), event->content.length());
+      }
+      connection.hash = versions.back()->hash;
+   }
+   return 0;
+}
+
+
+//reply all versions of the resource, newer than the one known by the client, as one multipart message
+//each part carries the Content-Type, Content-Hash and Content-Length of its version
+static void m_reply_history(Connection& connection, DynamicResource * resource)
+{
+   static const char crlf[] = "\r\n";
+   const string& boundary = DynamicResource::getBoundary();
+   vector<RenderedContentPtr> versions;
+   resource->getHistory(connection.hash, versions);
+
+   //header
+   size_t length = boundary.length() + 6; //closing delimiter "--" boundary "--\r\n"
+   for (size_t i = 0; i < versions.size(); ++i)
+   {
+      length += versions[i]->part.length() + versions[i]->content.length() + 2;
+   }
+   string header;
+   header  = "HTTP/1.1 " + resource->getStatusCode() + "\r\n";
+   header += "Content-Type: multipart/mixed; boundary=" + boundary + "\r\n";
+   header += "Content-Hash: " + to_string(versions.back()->hash) + "\r\n";
+   header += "Content-Length: " + to_string(length) + "\r\n";
+   header += (connection.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+   header += "\r\n";
+   connection.connection.send((const uint8_t *)header.c_str(), header.length(), true);
+
+   //parts (the pre-rendered versions are referenced, not copied)
+   for (size_t i = 0; i < versions.size(); ++i)
+   {
+      struct iovec iov[3];
+      iov[0].iov_base = (void *)versions[i]->part.c_str();
+      iov[0].iov_len = versions[i]->part.length();
+      iov[1].iov_base = (void *)versions[i]->content.c_str();
+      iov[1].iov_len = versions[i]->content.length();
+      iov[2].iov_base = (void *)crlf;
+      iov[2].iov_len = 2;
+      connection.connection.send(versions[i], iov, 3, true);
+   }
+   const string trailer = "--" + boundary + "--\r\n";
+   connection.connection.send((const uint8_t *)trailer.c_str(), trailer.length());
+}
+
+
+//compressed variant of a rendered reply, in the preferred coding accepted by the client
+//the reply itself, if none is accepted (or compression wasn't worth it)
+static RenderedContentPtr m_select_encoding(const RenderedContentPtr& rendered, unsigned encodings)
+{
+   for (int i = 0; i < Compression::ENCODINGS; ++i)
+   {
+      if (rendered->encoded[i] && (encodings & (1u << i)))
+      {
+         return rendered->encoded[i];
+      }
+   }
+   return rendered;
+}
+
+
+//return 0 when not found
+//return 1 when static content was replied
 static int m_reply_static_content(Connection& connection, const string& uri)
 {
    const string contentType = m_get_content_type_by_uri(uri, "application/octet-stream"); //default: binary data
    const string filePath = htmlBasePath + uri;
-   ifstream file(filePath, ios::in | ios::binary);
-   if (file.is_open())
-   {
-      //get size of file
-      file.seekg(0, ios::end);
-      int fileSize = file.tellg();
-
-      //read file content into tbuffer
-      uint8_t* buffer = new uint8_t[fileSize];
-      file.seekg(0, ios::beg);
-      file.read((char *)buffer, fileSize);
-
-      //close file
-      file.close();
-
-      //send header
-      string header = "HTTP/1.1 200 OK\r\n";
-      header += "Content-Type: " + contentType + "\r\n";
-      header += "Content-Length: " + to_string(fileSize) + "\r\n";
-      header += "\r\n";
-      connection.connection->send((const uint8_t *)header.c_str(), header.length(), true);
-      //send content
-      connection.connection->send(buffer, fileSize);
+   int fd;
+   StaticFilePtr file = staticCache->get(filePath, contentType, &fd);
+   if (file)
+   {
+      //prefer a precompressed sibling (held in memory), if the client accepts its coding
+      for (int i = 0; i < Compression::ENCODINGS; ++i)
+      {
+         if (file->encoded[i] && (connection.encodings & (1u << i)))
+         {
+            file = file->encoded[i];
+            if (fd >= 0)
+            {
+               ::close(fd);
+               fd = -1;
+            }
+            break;
+         }
+      }
 
-      //free buffer
-      delete[] buffer;
-      return 1; //instruct to close connection
+      //send pre-rendered header (the cached file is referenced, not copied, if it can't be sent immediately)
+      const string& header = file->header[connection.keepAlive ? 1 : 0];
+      connection.connection.send(file, (const uint8_t *)header.c_str(), header.length(), true);
+      if (fd >= 0) //large file -> stream content by sendfile
+      {
+         connection.connection.sendFile(fd, 0, (size_t)file->length);
+         return 1; //replied
+      }
+      //send content
+      connection.connection.send(file, (const uint8_t *)file->content.c_str(), file->content.length());
+      return 1; //replied
    }
    return 0; //not found
 }
 
 
+//send queued data of the connection, as far as the socket accepts it
+//return 0 when connection stays open
+//return -1 in case of connection errors
+//return 1 when connection shall be closed (all data was sent)
+static int m_flush_connection(Connection& connection)
+{
+   long status = connection.connection.flush();
+   if (status < 0)
+   {
+      return -1;
+   }
+   if (connection.closing && (status == 0))
+   {
+      return 1;
+   }
+   return 0;
+}
+
+
+//close connection, depending on the status returned by request processing
+//status < 0: close immediately; status > 0: close, once all queued data was sent
+//otherwise the timer of the connection is updated (the connection was active)
+static void m_update_connection(Worker& worker, Connection& connection, int status)
+{
+   if ((status > 0) && (connection.connection.getPending() > 0))
+   {
+      connection.closing = true; //closed by m_flush_connection
+      m_update_timer(worker, connection);
+      return;
+   }
+   if (status != 0)
+   {
+      m_close_connection(worker, connection);
+      return;
+   }
+   m_update_timer(worker, connection);
+}
+
+
+static void m_close_connection(Worker& worker, Connection& connection)
+{
+   //a deferred request must no longer be notified
+   DynamicResource::removeWaiter(*worker.replyQueue, &connection.waiter);
+   worker.timers->cancel(&connection.timer);
+
+   //close that connection (this also removes the socket from the event loop)
+   connection.connection.close();
+   connection.request.clear(); //drop unprocessed data (the buffer is kept for the next connection using that slot)
+   string().swap(connection.message);
+
+   //return to the pool of connections (for reuse by the next accepted one)
+   worker.connections->release(connection.slot);
+}
+
+
+//(re-)arm the timer of an active connection, depending on its state
+//the header and long polling timeouts run from the start of the request; the idle timeout from the last activity
+static void m_update_timer(Worker& worker, Connection& connection)
+{
+   Timeout timeout;
+   uint64_t delay;
+
+   if (connection.stream) //streams are never timed out (but probed)
+   {
+      worker.timers->cancel(&connection.timer);
+      connection.timeout = TIMEOUT_NONE;
+      m_enable_probes(connection);
+      return;
+   }
+   if (connection.resource != NULL)
+   {
+      timeout = TIMEOUT_POLL;
+      delay = pollTimeout;
+   }
+   else if ((connection.connection.getPending() == 0) && (connection.request.length() > 0) && !connection.request.hasHeader())
+   {
+      timeout = TIMEOUT_HEADER;
+      delay = headerTimeout;
+   }
+   else //slow readers are active as long as they make progress
+   {
+      timeout = TIMEOUT_IDLE;
+      delay = idleTimeout;
+   }
+
+   if ((timeout == TIMEOUT_IDLE) || (timeout != connection.timeout))
+   {
+      if (delay > 0)
+      {
+         worker.timers->arm(&connection.timer, m_now() + delay);
+      }
+      else
+      {
+         worker.timers->cancel(&connection.timer);
+         m_enable_probes(connection);
+      }
+      connection.timeout = timeout;
+   }
+}
+
+
+//connections waiting without timer (streams, deferred requests without poll timeout) are probed by TCP keepalive
+//thus half-open ones (e.g. the host of the client is gone) are closed after the idle timeout and the unanswered probes
+static void m_enable_probes(Connection& connection)
+{
+   if (!connection.probed && (idleTimeout > 0))
+   {
+      const int idle = (int)max<uint64_t>(idleTimeout / 1000, 1);
+      connection.connection.setKeepAlive(idle, KEEPALIVE_INTERVAL, KEEPALIVE_PROBES);
+      connection.probed = true;
+   }
+}
+
+
+//handle the connections, whose timer has expired
+//deferred requests are replied "304 Not Modified" (then requests pipelined behind them are processed); others are closed
+//returns time in ms until the next timer expires; -1 if no timer is armed
+static int m_expire_timers(Worker& worker, const RouteTable& routes)
+{
+   const uint64_t now = m_now();
+   Timer * timer;
+   int status;
+
+   while ((timer = worker.timers->expire(now)) != NULL)
+   {
+      Connection& con = *(Connection *)timer->context;
+      if (con.timeout != TIMEOUT_POLL)
+      {
+         m_close_connection(worker, con);
+         continue;
+      }
+      status = m_reply_not_modified(worker, con);
+      if (status == 0)
+      {
+         status = m_process_requests(worker, con, routes);
+      }
+      m_update_connection(worker, con, status); //close connection, if required
+   }
+   return worker.timers->getTimeout(now);
+}
+
+
+//reply a deferred request, whose content didn't change within the long polling timeout
+//the Content-Hash is still the one known by the client (the client re-arms the request with it)
+//return 0 when connection stays open
+//return 1 when connection shall be closed
+static int m_reply_not_modified(Worker& worker, Connection& connection)
+{
+   string reply = "HTTP/1.1 304 Not Modified\r\nContent-Hash: " + to_string(connection.hash) + "\r\n";
+   reply += connection.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+   DynamicResource::removeWaiter(*worker.replyQueue, &connection.waiter);
+   connection.connection.send((const uint8_t *)reply.data(), reply.length());
+
+   //invalidate request
+   connection.resource = NULL;
+   connection.hash = 0;
+   connection.batch = false;
+   connection.delta = false;
+   m_update_timer(worker, connection); //connection is idle again
+   return (connection.keepAlive ? 0 : 1);
+}
+
+
+//HTTP/1.1 connections are persistent, unless "Connection: close" is requested
+//HTTP/1.0 connections are closed, unless "Connection: keep-alive" is requested
+static bool m_is_keep_alive(const char * request, const hqsp_request_t& parsed)
+{
+   const char * header;
+   int headerLen;
+
+   headerLen = hqsp_get_parsed_header_value(request, &parsed, "Connection", &header);
+   if ((headerLen == 5) && (strncasecmp(header, "close", 5) == 0))
+   {
+      return false;
+   }
+   if ((headerLen == 10) && (strncasecmp(header, "keep-alive", 10) == 0))
+   {
+      return true;
+   }
+
+   //otherwise: depends on protocol version
+   return (parsed.version.length > 0) && !hqsp_view_equals(request, parsed.version, "HTTP/1.0");
+}
+
+
+//check if a header value (a comma separated list, e.g. "keep-alive, Upgrade") contains the token (case insensitive)
+static bool m_has_token(const char * value, int valueLen, const char * token)
+{
+   const int tokenLen = (int)strlen(token);
+   int start = 0;
+   while (start < valueLen)
+   {
+      int end = start;
+      while ((end < valueLen) && (value[end] != ','))
+      {
+         ++end;
+      }
+      int first = start;
+      int last = end;
+      while ((first < last) && ((value[first] == ' ') || (value[first] == '\t')))
+      {
+         ++first;
+      }
+      while ((last > first) && ((value[last - 1] == ' ') || (value[last - 1] == '\t')))
+      {
+         --last;
+      }
+      if (((last - first) == tokenLen) && (strncasecmp(&value[first], token, tokenLen) == 0))
+      {
+         return true;
+      }
+      start = end + 1;
+   }
+   return false;
+}
+
+
+//monotonic time in ms
+static uint64_t m_now()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+}
+
+
 static string m_get_content_type_by_uri(const string& uri, const string& fallback)
 {
    //get file extension
@@ -0,0 +1,174 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Growable per-connection receive buffer, reassembling HTTP requests
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include <stdlib.h>
+#include "request_buffer.h"
+#include "hqsp.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define KEEP_CAPACITY   (16 * 1024) //max. capacity kept, when the buffer runs empty (larger ones are released, e.g. after large POSTs)
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+RequestBuffer::RequestBuffer()
+{
+   this->begin = 0;
+   this->end = 0;
+   this->scanned = 0;
+   this->headerLen = 0;
+   this->bodyLen = 0;
+}
+
+
+uint8_t * RequestBuffer::reserve(size_t len)
+{
+   //move remaining data to the front, to reuse consumed space
+   if ((this->begin > 0) && ((this->buffer.size() - this->end) < (len + 1)))
+   {
+      memmove(&this->buffer[0], &this->buffer[this->begin], this->end - this->begin);
+      this->end -= this->begin;
+      this->begin = 0;
+   }
+   //grow (+1: keep space for a terminating byte behind the data)
+   if ((this->buffer.size() - this->end) < (len + 1))
+   {
+      size_t capacity = this->buffer.size() ? this->buffer.size() : 4096;
+      while ((capacity - this->end) < (len + 1))
+      {
+         capacity *= 2;
+      }
+      this->buffer.resize(capacity);
+   }
+   return this->buffer.data() + this->end;
+}
+
+
+void RequestBuffer::commit(size_t len)
+{
+   this->end += len;
+}
+
+
+long RequestBuffer::check(size_t maxHeaderSize, size_t maxBodySize)
+{
+   const size_t available = this->end - this->begin;
+
+   //tokenize header, once it is complete
+   if (this->headerLen == 0)
+   {
+      const char * data = (const char *)this->buffer.data() + this->begin;
+      if (this->scanned == 0) //usually the header is received at once -> tokenize it right away
+      {
+         this->headerLen = hqsp_parse_request(data, (unsigned)available, &this->parsed);
+      }
+      else //search for end of header, continuing where the last search stopped (headers may arrive in many segments)
+      {
+         size_t i = (this->scanned > 3) ? (this->scanned - 3) : 0;
+         if (hqsp_get_header_length(data + i, (unsigned)(available - i)) > 0)
+         {
+            this->headerLen = hqsp_parse_request(data, (unsigned)available, &this->parsed);
+         }
+      }
+      this->scanned = available;
+
+      if (this->headerLen == 0) //end of header not yet received
+      {
+         return (available > maxHeaderSize) ? HEADER_TOO_LARGE : INCOMPLETE;
+      }
+
+      //header is complete -> get length of body
+      const char * value;
+      int valueLen = hqsp_get_parsed_header_value(data, &this->parsed, "Content-Length", &value);
+      this->bodyLen = (valueLen > 0) ? strtoul(value, NULL, 10) : 0;
+   }
+
+   if (this->parsed.tooManyHeaders) //(fields would be ignored, e.g. Content-Length - misparsing the rest of the stream)
+   {
+      return HEADER_TOO_LARGE;
+   }
+   if (this->bodyLen > maxBodySize)
+   {
+      return BODY_TOO_LARGE;
+   }
+   if (available < (this->headerLen + this->bodyLen))
+   {
+      return INCOMPLETE;
+   }
+   return (long)(this->headerLen + this->bodyLen);
+}
+
+
+const hqsp_request_t& RequestBuffer::header() const
+{
+   return this->parsed;
+}
+
+
+bool RequestBuffer::hasHeader() const
+{
+   return (this->headerLen > 0);
+}
+
+
+char * RequestBuffer::data()
+{
+   return (char *)(this->buffer.data() + this->begin);
+}
+
+
+size_t RequestBuffer::length() const
+{
+   return (this->end - this->begin);
+}
+
+
+void RequestBuffer::consume(size_t len)
+{
+   this->begin += len;
+   this->scanned = 0;
+   this->headerLen = 0;
+   this->bodyLen = 0;
+   if (this->begin >= this->end)
+   {
+      //reuse the buffer for the next request (without reallocation), unless it grew large
+      if (this->buffer.size() > KEEP_CAPACITY)
+      {
+         vector<uint8_t>().swap(this->buffer);
+      }
+      this->begin = 0;
+      this->end = 0;
+   }
+}
+
+
+void RequestBuffer::clear()
+{
+   if (this->buffer.size() > KEEP_CAPACITY) //(like consume)
+   {
+      vector<uint8_t>().swap(this->buffer);
+   }
+   this->begin = 0;
+   this->end = 0;
+   this->scanned = 0;
+   this->headerLen = 0;
+   this->bodyLen = 0;
+}
+
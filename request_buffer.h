@@ -0,0 +1,81 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Growable per-connection receive buffer, reassembling HTTP requests
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef REQUEST_BUFFER_H_INCLUDED
+#define REQUEST_BUFFER_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "hqsp.h"
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+class RequestBuffer
+{
+public:
+   //return values of check()
+   enum
+   {
+      INCOMPLETE = 0, //more data required
+      HEADER_TOO_LARGE = -1, //no end of header within maxHeaderSize bytes, or more than HQSP_MAX_HEADERS fields
+      BODY_TOO_LARGE = -2, //Content-Length exceeds maxBodySize
+   };
+
+   RequestBuffer();
+
+   //get space for (at least) the given number of bytes to receive into
+   uint8_t * reserve(size_t len);
+
+   //mark the given number of bytes, received into the reserved space, as valid
+   void commit(size_t len);
+
+   //check if the buffer starts with a complete request (header terminated by "\r\n\r\n",
+   //followed by Content-Length bytes of body)
+   //returns length of the complete request; INCOMPLETE, HEADER_TOO_LARGE or BODY_TOO_LARGE otherwise
+   long check(size_t maxHeaderSize, size_t maxBodySize);
+
+   //tokenized header of the request at the start of the buffer (valid, once check() returned a complete request)
+   const hqsp_request_t& header() const;
+
+   //check if the end of header of the request at the start of the buffer was found (by check())
+   bool hasHeader() const;
+
+   //start of buffered data (the byte following the data is always accessible and may be modified)
+   char * data();
+   size_t length() const;
+
+   //drop the given number of bytes from the start of the buffer
+   //when the buffer runs empty, its memory is kept for the next request (unless it grew large)
+   void consume(size_t len);
+
+   //drop all data (e.g. when the connection is closed); the memory is kept for reuse (up to the same limit as consume)
+   void clear();
+
+private:
+   std::vector<uint8_t> buffer;
+   size_t begin; //start of valid data
+   size_t end; //end of valid data
+   size_t scanned; //number of bytes (from begin) already searched for the end of header
+   size_t headerLen; //length of header (including "\r\n\r\n"); 0 if not yet known
+   size_t bodyLen; //value of Content-Length
+   hqsp_request_t parsed; //tokenized header; valid if headerLen is known
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // REQUEST_BUFFER_H_INCLUDED
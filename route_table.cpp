@@ -0,0 +1,404 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Hashed routing table, resolving URIs to dynamic resources in constant time, and a radix tree of URI patterns
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include "route_table.h"
+#include "snapshot_store.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define INITIAL_CAPACITY   64 //must be a power of 2
+#define NO_NODE            0xFFFFFFFF
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+atomic<size_t> TopicPattern::count(0);
+size_t TopicPattern::limit = 0;
+SnapshotStore * TopicPattern::snapshot = NULL;
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+RouteTable::RouteTable()
+{
+   Slot empty = { 0, NULL };
+   this->slots.assign(INITIAL_CAPACITY, empty);
+   this->count = 0;
+   Node root;
+   root.pattern = NULL;
+   this->nodes.push_back(root);
+}
+
+
+bool RouteTable::insert(DynamicResource * resource)
+{
+   const string& uri = resource->uri;
+   if (this->findExact(uri.c_str(), uri.length()) != NULL)
+   {
+      return false; //already present
+   }
+
+   //keep load factor below 1/2, to keep probe sequences short
+   if (2 * (this->count + 1) > this->slots.size())
+   {
+      this->grow();
+   }
+
+   const size_t mask = this->slots.size() - 1;
+   const uint32_t hash = hashOf(uri.c_str(), uri.length());
+   size_t i = hash & mask;
+   while (this->slots[i].resource != NULL)
+   {
+      i = (i + 1) & mask;
+   }
+   this->slots[i].hash = hash;
+   this->slots[i].resource = resource;
+   this->count++;
+   return true;
+}
+
+
+bool RouteTable::remove(DynamicResource * resource)
+{
+   const size_t mask = this->slots.size() - 1;
+   size_t i = hashOf(resource->uri.c_str(), resource->uri.length()) & mask;
+
+   //find slot of resource
+   while (this->slots[i].resource != resource)
+   {
+      if (this->slots[i].resource == NULL)
+      {
+         return false; //not found
+      }
+      i = (i + 1) & mask;
+   }
+
+   //backward shift deletion: move subsequent entries of the probe sequence into the gap
+   //(no tombstones, so lookups never degrade)
+   size_t gap = i;
+   for (size_t j = (i + 1) & mask; this->slots[j].resource != NULL; j = (j + 1) & mask)
+   {
+      const size_t home = this->slots[j].hash & mask;
+      //entry at j may fill the gap, if its home slot is not within (gap, j]
+      if (((j - home) & mask) >= ((j - gap) & mask))
+      {
+         this->slots[gap] = this->slots[j];
+         gap = j;
+      }
+   }
+   this->slots[gap].hash = 0;
+   this->slots[gap].resource = NULL;
+   this->count--;
+   return true;
+}
+
+
+bool RouteTable::insert(TopicPattern * pattern)
+{
+   const string& prefix = pattern->prefix;
+   uint32_t node = 0;
+   size_t pos = 0;
+   while (pos < prefix.length())
+   {
+      const uint32_t child = this->findChild(node, prefix[pos]);
+      if (child == NO_NODE) //new leaf
+      {
+         Node leaf;
+         leaf.label = prefix.substr(pos);
+         leaf.pattern = pattern;
+         this->nodes.push_back(leaf);
+         this->nodes[node].children.push_back((uint32_t)(this->nodes.size() - 1));
+         return true;
+      }
+
+      //length of the common part of label and prefix
+      const string& label = this->nodes[child].label;
+      size_t common = 1;
+      while ((common < label.length()) && ((pos + common) < prefix.length()) && (label[common] == prefix[pos + common]))
+      {
+         ++common;
+      }
+      if (common < label.length()) //split edge: node -> inner (common part) -> child (rest of label)
+      {
+         Node inner;
+         inner.label = label.substr(0, common);
+         inner.children.push_back(child);
+         inner.pattern = NULL;
+         this->nodes[child].label.erase(0, common);
+         this->nodes.push_back(inner);
+         const uint32_t index = (uint32_t)(this->nodes.size() - 1);
+         vector<uint32_t>& children = this->nodes[node].children;
+         for (size_t i = 0; i < children.size(); ++i)
+         {
+            if (children[i] == child)
+            {
+               children[i] = index;
+            }
+         }
+         node = index;
+      }
+      else
+      {
+         node = child;
+      }
+      pos += common;
+   }
+   if (this->nodes[node].pattern != NULL)
+   {
+      return false; //already present
+   }
+   this->nodes[node].pattern = pattern;
+   return true;
+}
+
+
+DynamicResource * RouteTable::find(const char * uri, size_t uriLen) const
+{
+   DynamicResource * resource = this->findExact(uri, uriLen);
+   if (resource == NULL)
+   {
+      TopicPattern * pattern = this->match(uri, uriLen);
+      if (pattern != NULL)
+      {
+         resource = pattern->get(uri, uriLen, false);
+      }
+   }
+   return resource;
+}
+
+
+TopicPattern * RouteTable::match(const char * uri, size_t uriLen) const
+{
+   TopicPattern * pattern = NULL;
+   uint32_t node = 0;
+   size_t pos = 0;
+   while (pos < uriLen)
+   {
+      if (this->nodes[node].pattern != NULL)
+      {
+         pattern = this->nodes[node].pattern; //(longer prefixes are found further down)
+      }
+      node = this->findChild(node, uri[pos]);
+      if (node == NO_NODE)
+      {
+         break;
+      }
+      const string& label = this->nodes[node].label;
+      if ((label.length() > (uriLen - pos)) || (memcmp(label.data(), &uri[pos], label.length()) != 0))
+      {
+         break;
+      }
+      pos += label.length();
+   }
+   return pattern;
+}
+
+
+DynamicResource * RouteTable::findExact(const char * uri, size_t uriLen) const
+{
+   const size_t mask = this->slots.size() - 1;
+   const uint32_t hash = hashOf(uri, uriLen);
+   size_t i = hash & mask;
+   while (1)
+   {
+      const Slot& slot = this->slots[i];
+      if (slot.resource == NULL)
+      {
+         return NULL; //not found
+      }
+      //compare precomputed hash first; strings only on hash match
+      if ((slot.hash == hash) && (slot.resource->uri.length() == uriLen) &&
+          (memcmp(slot.resource->uri.data(), uri, uriLen) == 0))
+      {
+         return slot.resource;
+      }
+      i = (i + 1) & mask;
+   }
+}
+
+
+size_t RouteTable::size() const
+{
+   return this->count;
+}
+
+
+uint32_t RouteTable::hashOf(const char * uri, size_t uriLen)
+{
+   uint32_t hash = 2166136261u;
+   for (size_t i = 0; i < uriLen; ++i)
+   {
+      hash ^= (uint8_t)uri[i];
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+
+//child of the node, whose label starts with the given byte; NO_NODE if there is none
+//(a node has at most 256 children)
+uint32_t RouteTable::findChild(uint32_t node, char first) const
+{
+   const vector<uint32_t>& children = this->nodes[node].children;
+   for (size_t i = 0; i < children.size(); ++i)
+   {
+      if (this->nodes[children[i]].label[0] == first)
+      {
+         return children[i];
+      }
+   }
+   return NO_NODE;
+}
+
+
+void RouteTable::grow()
+{
+   vector<Slot> old;
+   Slot empty = { 0, NULL };
+
+   //rehash all entries into a table of twice the size
+   old.swap(this->slots);
+   this->slots.assign(2 * old.size(), empty);
+   const size_t mask = this->slots.size() - 1;
+   for (size_t k = 0; k < old.size(); ++k)
+   {
+      if (old[k].resource != NULL)
+      {
+         size_t i = old[k].hash & mask;
+         while (this->slots[i].resource != NULL)
+         {
+            i = (i + 1) & mask;
+         }
+         this->slots[i] = old[k];
+      }
+   }
+}
+
+
+
+
+TopicPattern::TopicPattern(const string& prefix)
+{
+   this->prefix = prefix;
+   this->retired = false;
+}
+
+
+TopicPattern::~TopicPattern()
+{
+   for (size_t i = 0; i < this->created.size(); ++i)
+   {
+      delete this->created[i];
+   }
+}
+
+
+DynamicResource * TopicPattern::get(const char * uri, size_t uriLen, bool create)
+{
+   //lookup of existing resources (concurrently by all workers)
+   {
+      shared_lock<shared_timed_mutex> lock(this->mutex);
+      DynamicResource * resource = this->resources.find(uri, uriLen);
+      if ((resource != NULL) && !resource->isRetired())
+      {
+         return resource;
+      }
+      if (this->retired)
+      {
+         return NULL;
+      }
+   }
+
+   //create (or revive) resource, if requested or persisted before
+   if (!create && (snapshot == NULL))
+   {
+      return NULL;
+   }
+   const string name(uri, uriLen);
+   if (!create && !snapshot->contains(name))
+   {
+      return NULL;
+   }
+   lock_guard<shared_timed_mutex> lock(this->mutex);
+   DynamicResource * resource = this->resources.find(uri, uriLen); //(may have been created meanwhile)
+   if ((resource != NULL) && !resource->isRetired())
+   {
+      return resource;
+   }
+   if (this->retired)
+   {
+      return NULL;
+   }
+   if (resource != NULL) //retired with the pattern before
+   {
+      resource->revive();
+   }
+   else
+   {
+      if (count.fetch_add(1) >= limit) //(reserve a resource of the limit, shared by all patterns)
+      {
+         count.fetch_sub(1);
+         return NULL;
+      }
+      resource = new DynamicResource(name);
+      this->resources.insert(resource);
+      this->created.push_back(resource);
+   }
+   if (snapshot != NULL)
+   {
+      resource->setSnapshot(snapshot);
+   }
+   return resource;
+}
+
+
+void TopicPattern::retire()
+{
+   lock_guard<shared_timed_mutex> lock(this->mutex);
+   this->retired = true;
+   for (size_t i = 0; i < this->created.size(); ++i)
+   {
+      if (!this->created[i]->isRetired())
+      {
+         this->created[i]->retire();
+      }
+   }
+}
+
+
+void TopicPattern::revive()
+{
+   lock_guard<shared_timed_mutex> lock(this->mutex);
+   this->retired = false;
+}
+
+
+bool TopicPattern::isRetired()
+{
+   shared_lock<shared_timed_mutex> lock(this->mutex);
+   return this->retired;
+}
+
+
+void TopicPattern::setLimit(size_t limit)
+{
+   TopicPattern::limit = limit;
+}
+
+
+void TopicPattern::setSnapshot(SnapshotStore * store)
+{
+   snapshot = store;
+}
@@ -0,0 +1,140 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Hashed routing table, resolving URIs to dynamic resources in constant time, and a radix tree of URI patterns
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef ROUTE_TABLE_H_INCLUDED
+#define ROUTE_TABLE_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include "dynamic_resource.h"
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+class TopicPattern;
+
+
+//open addressing hash table (linear probing) with precomputed URI hashes
+//URIs, that are not in the table, are matched against the patterns (longest prefix, by a radix tree)
+class RouteTable
+{
+public:
+   RouteTable();
+
+   //add resource to the table
+   //returns true on success; false if a resource with the same URI already exists
+   bool insert(DynamicResource * resource);
+
+   //add pattern (URIs starting with its prefix) to the radix tree
+   //returns true on success; false if a pattern with the same prefix already exists
+   bool insert(TopicPattern * pattern);
+
+   //remove resource from the table
+   //returns true on success; false if resource is not in the table
+   bool remove(DynamicResource * resource);
+
+   //find resource by URI, given as "string-pointer" and length (e.g. as returned by hqsp_get_resource)
+   //resources of the table are preferred to those created by a pattern
+   //returns NULL if not found
+   DynamicResource * find(const char * uri, size_t uriLen) const;
+
+   //find resource of the table by URI (resources created by patterns are not considered; nothing is created)
+   //returns NULL if not found
+   DynamicResource * findExact(const char * uri, size_t uriLen) const;
+
+   //find pattern with the longest prefix of the URI (the URI must be longer than the prefix)
+   //takes time proportional to the length of the URI, independent of the number of patterns
+   //returns NULL if no pattern matches
+   TopicPattern * match(const char * uri, size_t uriLen) const;
+
+   size_t size() const;
+
+   //hash function applied to URIs (FNV-1a)
+   static uint32_t hashOf(const char * uri, size_t uriLen);
+
+private:
+   typedef struct
+   {
+      uint32_t hash;
+      DynamicResource * resource; //NULL if slot is empty
+   } Slot;
+
+   //node of the radix tree. the edge to a node is labeled by a (non-empty) part of the prefixes
+   //the labels of the children of a node start with distinct bytes
+   typedef struct
+   {
+      std::string label;
+      std::vector<uint32_t> children; //indices of the child nodes
+      TopicPattern * pattern; //pattern, whose prefix ends at this node; NULL if none
+   } Node;
+
+   uint32_t findChild(uint32_t node, char first) const;
+   void grow();
+
+   std::vector<Slot> slots; //capacity is always a power of 2
+   size_t count;
+   std::vector<Node> nodes; //radix tree of the patterns; [0]: root (empty label)
+};
+
+
+//a pattern of URIs (e.g. "/sensors/*" for all URIs starting with "/sensors/"). resources of matching URIs
+//are created on demand (see get), as long as the number of created resources is below the limit
+//resources are never deleted while the server is running (requests of all workers may refer to them)
+class TopicPattern
+{
+public:
+   TopicPattern(const std::string& prefix);
+   ~TopicPattern();
+
+   //get resource of a matching URI. it is created, if it doesn't exist yet, if either create is set, or the
+   //resource was persisted before (see setSnapshot), as long as the pattern isn't retired (thread safe)
+   //returns NULL if not found (or not created)
+   DynamicResource * get(const char * uri, size_t uriLen, bool create);
+
+   //withdraw the pattern (e.g. removed from the configuration), retiring all its resources
+   //resources aren't created, until the pattern is revived (retired resources are revived on demand)
+   void retire();
+   void revive();
+   bool isRetired();
+
+   //max. number of resources created by all patterns
+   static void setLimit(size_t limit);
+
+   //resources created by patterns are restored from (and persisted into) the given store
+   static void setSnapshot(SnapshotStore * store);
+
+   std::string prefix;
+
+private:
+   TopicPattern(const TopicPattern&); //non-copyable (owns the resources)
+
+   std::shared_timed_mutex mutex; //protects all members below (shared by all workers; exclusive to create or retire resources)
+   RouteTable resources; //resources created by this pattern, by URI
+   std::vector<DynamicResource *> created;
+   bool retired;
+   static std::atomic<size_t> count; //number of resources created by all patterns
+   static size_t limit;
+   static SnapshotStore * snapshot;
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // ROUTE_TABLE_H_INCLUDED
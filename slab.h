@@ -0,0 +1,183 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Fixed-capacity pool of reusable objects, with an index-based set of the objects in use
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef SLAB_H_INCLUDED
+#define SLAB_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+#define SLAB_CACHE_LINE    64 //objects are aligned to cache lines (no false sharing, no straddling)
+#define SLAB_CHUNK_BITS    8 //objects are allocated in chunks of 256
+
+
+/* -- Types --------------------------------------------------------------- */
+//objects are constructed once (when their chunk is allocated) and reused afterwards - acquiring
+//and releasing them doesn't allocate memory (except for adding a chunk). the objects in use are
+//kept in a dense array of indices, to iterate over them contiguously
+template <typename T>
+class Slab
+{
+public:
+   enum
+   {
+      NONE = 0xFFFFFFFF, //no free object
+   };
+
+   //capacity: max. number of objects
+   Slab(uint32_t capacity);
+   ~Slab();
+
+   //take a free object (its state is the one left by its previous user)
+   //returns index of the object; NONE if all objects are in use
+   uint32_t acquire();
+
+   //return the object with the given index to the pool
+   void release(uint32_t index);
+
+   T& operator[](uint32_t index);
+
+   //number of objects in use, and the index of the i-th of them (the order changes on release)
+   uint32_t getActiveCount() const;
+   uint32_t getActive(uint32_t i) const;
+
+private:
+   struct alignas(SLAB_CACHE_LINE) Slot
+   {
+      T object;
+   };
+
+   Slab(const Slab&); //non-copyable (owns the chunks)
+   bool addChunk();
+
+   std::vector<Slot *> chunks;
+   std::vector<uint32_t> freeList; //indices of free objects (stack; recently used ones first)
+   std::vector<uint32_t> active; //indices of objects in use
+   std::vector<uint32_t> position; //position of each object within active
+   uint32_t capacity;
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+template <typename T>
+Slab<T>::Slab(uint32_t capacity)
+{
+   this->capacity = capacity;
+}
+
+
+template <typename T>
+Slab<T>::~Slab()
+{
+   const uint32_t chunkSize = 1u << SLAB_CHUNK_BITS;
+   for (size_t i = 0; i < this->chunks.size(); ++i)
+   {
+      for (uint32_t j = 0; j < chunkSize; ++j)
+      {
+         this->chunks[i][j].~Slot();
+      }
+      free(this->chunks[i]);
+   }
+}
+
+
+template <typename T>
+uint32_t Slab<T>::acquire()
+{
+   if (this->freeList.empty() && !this->addChunk())
+   {
+      return NONE;
+   }
+   const uint32_t index = this->freeList.back();
+   this->freeList.pop_back();
+   this->position[index] = (uint32_t)this->active.size();
+   this->active.push_back(index);
+   return index;
+}
+
+
+template <typename T>
+void Slab<T>::release(uint32_t index)
+{
+   //move last object in use to the position of the released one
+   const uint32_t last = this->active.back();
+   this->active[this->position[index]] = last;
+   this->position[last] = this->position[index];
+   this->active.pop_back();
+   this->freeList.push_back(index);
+}
+
+
+template <typename T>
+T& Slab<T>::operator[](uint32_t index)
+{
+   return this->chunks[index >> SLAB_CHUNK_BITS][index & ((1u << SLAB_CHUNK_BITS) - 1)].object;
+}
+
+
+template <typename T>
+uint32_t Slab<T>::getActiveCount() const
+{
+   return (uint32_t)this->active.size();
+}
+
+
+template <typename T>
+uint32_t Slab<T>::getActive(uint32_t i) const
+{
+   return this->active[i];
+}
+
+
+//allocate (and construct) the next chunk of objects, as far as the capacity permits
+template <typename T>
+bool Slab<T>::addChunk()
+{
+   const uint32_t chunkSize = 1u << SLAB_CHUNK_BITS;
+   const uint32_t first = (uint32_t)this->chunks.size() * chunkSize;
+   if (first >= this->capacity)
+   {
+      return false;
+   }
+
+   void * memory = NULL;
+   if (posix_memalign(&memory, SLAB_CACHE_LINE, chunkSize * sizeof(Slot)) != 0)
+   {
+      return false;
+   }
+   Slot * chunk = (Slot *)memory;
+   for (uint32_t j = 0; j < chunkSize; ++j)
+   {
+      new (&chunk[j]) Slot();
+   }
+   this->chunks.push_back(chunk);
+
+   //the book-keeping grows with each chunk, covering all of its objects (thus only adding a chunk reallocates it, never acquire or release)
+   const uint32_t count = ((first + chunkSize) < this->capacity) ? chunkSize : (this->capacity - first);
+   this->position.resize(first + chunkSize);
+   this->active.reserve(first + chunkSize);
+   this->freeList.reserve(first + chunkSize);
+   for (uint32_t j = count; j > 0; --j) //lowest index on top
+   {
+      this->freeList.push_back(first + j - 1);
+   }
+   return true;
+}
+
+
+
+#endif // SLAB_H_INCLUDED
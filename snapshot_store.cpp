@@ -0,0 +1,397 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Persistent store of the latest version of each dynamic resource (mmap'd, append-only log)
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "snapshot_store.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define MAGIC            "APOLLSN1" //first 8 bytes of the file (format version 1)
+#define MAGIC_SIZE       8
+#define MIN_CAPACITY     (1024 * 1024) //initial size of the file
+#define ALIGN(len)       (((len) + 7) & ~(size_t)7)
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+extern "C" unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+SnapshotStore::SnapshotStore()
+{
+   this->fd = -1;
+   this->data = NULL;
+   this->capacity = 0;
+   this->length = 0;
+   this->live = 0;
+   this->compactionDue = false;
+}
+
+
+SnapshotStore::~SnapshotStore()
+{
+   this->close();
+}
+
+
+int SnapshotStore::open(const string& path)
+{
+   struct stat info;
+
+   this->path = path;
+   this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if ((this->fd < 0) || (fstat(this->fd, &info) < 0))
+   {
+      cout << "Failed to open snapshot " << path << endl;
+      this->close();
+      return -1;
+   }
+
+   //new (or empty) file
+   const bool empty = ((size_t)info.st_size < MAGIC_SIZE);
+   this->capacity = empty ? MIN_CAPACITY : (size_t)info.st_size;
+   if (empty && (ftruncate(this->fd, this->capacity) < 0))
+   {
+      cout << "Failed to create snapshot " << path << endl;
+      this->close();
+      return -1;
+   }
+   this->data = map(this->fd, this->capacity);
+   if (this->data == NULL)
+   {
+      cout << "Failed to map snapshot " << path << endl;
+      this->close();
+      return -1;
+   }
+   if (empty)
+   {
+      memcpy(this->data, MAGIC, MAGIC_SIZE);
+   }
+   else if (memcmp(this->data, MAGIC, MAGIC_SIZE) != 0) //don't overwrite foreign files
+   {
+      cout << "Invalid snapshot " << path << endl;
+      this->close();
+      return -1;
+   }
+
+   //index the latest record of each resource, up to the first invalid one
+   size_t offset = MAGIC_SIZE;
+   while ((offset + sizeof(Record)) <= this->capacity)
+   {
+      Record record;
+      memcpy(&record, &this->data[offset], sizeof(record));
+      const size_t used = sizeof(Record) + record.contentLength + record.uriLength + record.typeLength;
+      if ((record.length < sizeof(Record)) || (record.length != ALIGN(used)) || (record.length > (this->capacity - offset)))
+      {
+         break;
+      }
+      if (record.crc != xcrc32(&this->data[offset + 8], (int)(used - 8), 0xFFFFFFFFuL))
+      {
+         break;
+      }
+      const string uri((const char *)&this->data[offset + sizeof(Record)], record.uriLength);
+      unordered_map<string, size_t>::iterator it = this->index.find(uri);
+      if (it != this->index.end())
+      {
+         this->live -= ((const Record *)&this->data[it->second])->length;
+         this->index.erase(it);
+      }
+      if (record.hash != 0) //otherwise: removed
+      {
+         this->index[uri] = offset;
+         this->live += record.length;
+      }
+      offset += record.length;
+   }
+   this->length = offset;
+
+   //discard the rest of the log (a torn record must not be completed by later appends)
+   memset(&this->data[this->length], 0, this->capacity - this->length);
+   return this->fd;
+}
+
+
+void SnapshotStore::close()
+{
+   if (this->data != NULL)
+   {
+      munmap(this->data, this->capacity);
+      this->data = NULL;
+   }
+   if (this->fd >= 0)
+   {
+      ::close(this->fd);
+      this->fd = -1;
+   }
+   this->index.clear();
+   this->capacity = 0;
+   this->length = 0;
+   this->live = 0;
+}
+
+
+bool SnapshotStore::load(const string& uri, string& contentType, string& content, uint64_t& hash)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   unordered_map<string, size_t>::const_iterator it = this->index.find(uri);
+   if (it == this->index.end())
+   {
+      return false;
+   }
+   const uint8_t * record = &this->data[it->second];
+   const Record * header = (const Record *)record;
+   record += sizeof(Record) + header->uriLength;
+   contentType.assign((const char *)record, header->typeLength);
+   record += header->typeLength;
+   content.assign((const char *)record, header->contentLength);
+   hash = header->hash;
+   return true;
+}
+
+
+bool SnapshotStore::contains(const string& uri)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   return (this->index.count(uri) > 0);
+}
+
+
+void SnapshotStore::store(const string& uri, const string& contentType, const string& content, uint64_t hash)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   if ((this->data == NULL) || (hash == 0))
+   {
+      return;
+   }
+   this->append(uri, contentType, content, hash);
+
+   //compact, when most of the log is outdated (see compact)
+   if ((this->length > MIN_CAPACITY) && (this->length > (2 * this->live)))
+   {
+      this->compactionDue = true;
+   }
+}
+
+
+void SnapshotStore::remove(const string& uri)
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   if ((this->data != NULL) && (this->index.count(uri) > 0))
+   {
+      this->append(uri, "", "", 0);
+   }
+}
+
+
+const string& SnapshotStore::getPath() const
+{
+   return this->path;
+}
+
+
+//append a record to the log, and update the index
+//(resources, whose URI, content type or content are too large for the record, are not persisted)
+void SnapshotStore::append(const string& uri, const string& contentType, const string& content, uint64_t hash)
+{
+   if ((uri.length() > 0xFFFF) || (contentType.length() > 0xFFFF) || (content.length() > 0x7FF00000))
+   {
+      return;
+   }
+   const size_t used = sizeof(Record) + content.length() + uri.length() + contentType.length();
+   if (!this->reserve(ALIGN(used)))
+   {
+      return;
+   }
+
+   //payload first, the header (incl. CRC) last
+   const size_t offset = this->length;
+   uint8_t * payload = &this->data[offset + sizeof(Record)];
+   memcpy(payload, uri.data(), uri.length());
+   payload += uri.length();
+   memcpy(payload, contentType.data(), contentType.length());
+   payload += contentType.length();
+   memcpy(payload, content.data(), content.length());
+   Record record;
+   record.length = (uint32_t)ALIGN(used);
+   record.crc = 0;
+   record.hash = hash;
+   record.contentLength = (uint32_t)content.length();
+   record.uriLength = (uint16_t)uri.length();
+   record.typeLength = (uint16_t)contentType.length();
+   memcpy(&this->data[offset], &record, sizeof(record));
+   record.crc = xcrc32(&this->data[offset + 8], (int)(used - 8), 0xFFFFFFFFuL);
+   memcpy(&this->data[offset], &record, sizeof(record));
+   this->length += record.length;
+
+   //update index
+   unordered_map<string, size_t>::iterator it = this->index.find(uri);
+   if (it != this->index.end())
+   {
+      this->live -= ((const Record *)&this->data[it->second])->length;
+      this->index.erase(it);
+   }
+   if (hash != 0)
+   {
+      this->index[uri] = offset;
+      this->live += record.length;
+   }
+}
+
+
+//make room for length bytes at the end of the log
+bool SnapshotStore::reserve(size_t length)
+{
+   return grow(this->fd, this->data, this->capacity, this->length + length);
+}
+
+
+//write the latest records into a new file, that replaces the log (by rename, thus the old log
+//stays intact until the new one is complete). the log is kept as it is, in case of errors
+//the store is locked while records are copied, but not while the new file is written to disk
+void SnapshotStore::compact()
+{
+   if (!this->compactionDue)
+   {
+      return;
+   }
+   const string tmpPath = this->path + ".tmp";
+   unordered_map<string, size_t> index;
+   uint8_t * data = NULL;
+   size_t capacity = MIN_CAPACITY;
+   size_t length = MAGIC_SIZE;
+   size_t copied; //end of the part of the log, that was copied
+   int fd;
+
+   //copy latest records
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      this->compactionDue = false;
+      while ((MAGIC_SIZE + (2 * this->live)) > capacity)
+      {
+         capacity *= 2;
+      }
+      fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd < 0)
+      {
+         return;
+      }
+      data = (ftruncate(fd, capacity) == 0) ? map(fd, capacity) : NULL;
+      if (data == NULL)
+      {
+         ::close(fd);
+         unlink(tmpPath.c_str());
+         return;
+      }
+      memcpy(data, MAGIC, MAGIC_SIZE);
+      for (unordered_map<string, size_t>::const_iterator it = this->index.begin(); it != this->index.end(); ++it)
+      {
+         const size_t recordLength = ((const Record *)&this->data[it->second])->length;
+         memcpy(&data[length], &this->data[it->second], recordLength);
+         index[it->first] = length;
+         length += recordLength;
+      }
+      copied = this->length;
+   }
+
+   //write to disk (without lock; versions may be appended to the log meanwhile)
+   bool failed = (msync(data, length, MS_SYNC) < 0);
+
+   //append the records, that were appended to the log meanwhile, and replace the log
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      for (size_t offset = copied; !failed && (offset < this->length); )
+      {
+         const Record * record = (const Record *)&this->data[offset];
+         failed = !grow(fd, data, capacity, length + record->length);
+         if (!failed)
+         {
+            const string uri((const char *)&this->data[offset + sizeof(Record)], record->uriLength);
+            memcpy(&data[length], record, record->length);
+            index.erase(uri);
+            if (record->hash != 0)
+            {
+               index[uri] = length;
+            }
+            length += record->length;
+            offset += record->length;
+         }
+      }
+      if (failed || (rename(tmpPath.c_str(), this->path.c_str()) < 0))
+      {
+         munmap(data, capacity);
+         ::close(fd);
+         unlink(tmpPath.c_str());
+         return;
+      }
+      munmap(this->data, this->capacity);
+      ::close(this->fd);
+      this->fd = fd;
+      this->data = data;
+      this->capacity = capacity;
+      this->length = length;
+      this->index.swap(index);
+   }
+
+   //make the rename durable
+   const size_t slash = this->path.rfind('/');
+   const string dir = (slash == string::npos) ? "." : ((slash == 0) ? "/" : this->path.substr(0, slash));
+   int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (dirFd >= 0)
+   {
+      fsync(dirFd);
+      ::close(dirFd);
+   }
+}
+
+
+//grow the file (and its mapping) by doubling, until it has at least the given size
+bool SnapshotStore::grow(int fd, uint8_t *& data, size_t& capacity, size_t size)
+{
+   if (size <= capacity)
+   {
+      return true;
+   }
+   size_t newCapacity = capacity;
+   while (size > newCapacity)
+   {
+      newCapacity *= 2;
+   }
+   if (ftruncate(fd, newCapacity) < 0)
+   {
+      return false;
+   }
+   void * newData = mremap(data, capacity, newCapacity, MREMAP_MAYMOVE);
+   if (newData == MAP_FAILED)
+   {
+      return false;
+   }
+   data = (uint8_t *)newData;
+   capacity = newCapacity;
+   return true;
+}
+
+
+uint8_t * SnapshotStore::map(int fd, size_t capacity)
+{
+   void * data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   return (data != MAP_FAILED) ? (uint8_t *)data : NULL;
+}
@@ -0,0 +1,99 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Persistent store of the latest version of each dynamic resource (mmap'd, append-only log)
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef SNAPSHOT_STORE_H_INCLUDED
+#define SNAPSHOT_STORE_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+//each version is appended to the log as record (header, URI, content type, content; 8-byte aligned):
+//   length (4)          : size of the record, incl. header and padding
+//   crc (4)             : CRC32 of the rest of the record (excl. padding)
+//   hash (8)            : Content-Hash of the version; 0 marks a removed resource
+//   content length (4), URI length (2), content type length (2)
+//records are written to a shared mapping, thus they survive a crash of the server. the log ends at the
+//first record, that is incomplete or damaged (torn write). when most of the log is outdated, it is
+//compacted into a new file (containing the latest records only), that atomically replaces the old one
+//(by a thread calling compact, thus publishers don't wait for the disk)
+class SnapshotStore
+{
+public:
+   SnapshotStore();
+   ~SnapshotStore();
+
+   //open (or create) the store and index the latest record of each resource (a single pass over the log)
+   //returns -1 in case of errors
+   int open(const std::string& path);
+   void close();
+
+   //get the latest persisted version of a resource
+   //returns false, if there is none
+   bool load(const std::string& uri, std::string& contentType, std::string& content, uint64_t& hash);
+
+   //check, whether a resource was persisted (thread safe)
+   bool contains(const std::string& uri);
+
+   //persist a version of a resource (thread safe)
+   void store(const std::string& uri, const std::string& contentType, const std::string& content, uint64_t hash);
+
+   //forget a resource (thread safe)
+   void remove(const std::string& uri);
+
+   //compact the log, if most of it is outdated. call periodically, from a thread that doesn't serve requests
+   //(the new file is synced to disk, that may take a while)
+   void compact();
+
+   const std::string& getPath() const;
+
+private:
+   struct Record
+   {
+      uint32_t length;
+      uint32_t crc;
+      uint64_t hash;
+      uint32_t contentLength;
+      uint16_t uriLength;
+      uint16_t typeLength;
+   };
+
+   SnapshotStore(const SnapshotStore&); //non-copyable (owns the mapping)
+   void append(const std::string& uri, const std::string& contentType, const std::string& content, uint64_t hash);
+   bool reserve(size_t length);
+   static bool grow(int fd, uint8_t *& data, size_t& capacity, size_t size);
+   static uint8_t * map(int fd, size_t capacity);
+
+   std::string path;
+   int fd;
+   uint8_t * data; //mapping of the file
+   size_t capacity; //size of the file (and the mapping)
+   size_t length; //end of the log
+   size_t live; //size of the latest records (those, that are kept by compaction)
+   std::unordered_map<std::string, size_t> index; //offset of the latest record, by URI
+   std::atomic<bool> compactionDue;
+   std::mutex mutex; //protects the log and the index (shared by all workers)
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // SNAPSHOT_STORE_H_INCLUDED
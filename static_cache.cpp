@@ -0,0 +1,415 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief In-memory cache of static files, invalidated by inotify
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "static_cache.h"
+#include "event_loop.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define WATCH_EVENTS   (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static size_t m_get_size(const StaticFile& file);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+StaticCache::StaticCache(size_t budget, size_t maxFileSize)
+{
+   this->budget = budget;
+   this->maxFileSize = maxFileSize;
+   this->size = 0;
+   this->generation = 0;
+   this->inotifyFd = -1;
+}
+
+
+StaticCache::~StaticCache()
+{
+   this->close();
+}
+
+
+int StaticCache::open()
+{
+   this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   return this->inotifyFd;
+}
+
+
+void StaticCache::close()
+{
+   lock_guard<std::mutex> lock(this->mutex);
+   if (this->inotifyFd >= 0)
+   {
+      ::close(this->inotifyFd);
+      this->inotifyFd = -1;
+   }
+   this->entries.clear();
+   this->lru.clear();
+   this->directories.clear();
+   this->watches.clear();
+   this->size = 0;
+}
+
+
+void StaticCache::attach(EventLoop& eventLoop)
+{
+   if (this->inotifyFd >= 0)
+   {
+      eventLoop.add(this->inotifyFd, EPOLLIN | EPOLLET, this);
+   }
+}
+
+
+void StaticCache::hide(const string& path)
+{
+   char resolved[PATH_MAX];
+   const size_t separator = path.find_last_of('/');
+   const string directory = (separator != string::npos) ? path.substr(0, separator + 1) : ".";
+   const string name = (separator != string::npos) ? path.substr(separator + 1) : path;
+   if (realpath(directory.c_str(), resolved) != NULL)
+   {
+      this->hidden.insert(string(resolved) + "/" + name);
+   }
+}
+
+
+StaticFilePtr StaticCache::get(const string& path, const string& contentType, int * fd)
+{
+   bool cacheable = false;
+   uint64_t generation = 0;
+   StaticFilePtr streamed;
+
+   *fd = -1;
+   //cache hit?
+   {
+      lock_guard<std::mutex> lock(this->mutex);
+      unordered_map<string, Entry>::iterator it = this->entries.find(path);
+      if (it != this->entries.end())
+      {
+         //move to front of LRU list
+         this->lru.splice(this->lru.begin(), this->lru, it->second.lru);
+         if (it->second.file->length <= this->maxFileSize)
+         {
+            return it->second.file;
+         }
+         streamed = it->second.file;
+      }
+
+      //the directory is watched before the file is read, so no change gets lost
+      else if ((this->inotifyFd >= 0) && (this->budget > 0))
+      {
+         const size_t separator = path.find_last_of('/');
+         const string directory = (separator != string::npos) ? path.substr(0, separator) : ".";
+         cacheable = this->watch(directory);
+         generation = this->generation;
+      }
+   }
+
+   //streamed file: header and siblings are cached, the file itself is opened for each request
+   if (streamed)
+   {
+      struct stat info;
+      *fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if ((*fd >= 0) && (fstat(*fd, &info) == 0) && S_ISREG(info.st_mode) && ((uint64_t)info.st_size == streamed->length))
+      {
+         return streamed;
+      }
+      if (*fd >= 0)
+      {
+         ::close(*fd);
+      }
+      return this->load(path, contentType, fd); //changed, but not yet reported by inotify -> load without caching
+   }
+
+   //otherwise: read file (without holding the lock)
+   StaticFilePtr file = this->load(path, contentType, fd);
+   if (!file || !cacheable)
+   {
+      return file; //not cacheable
+   }
+
+   //add to cache, unless a change was reported while the file was read
+   lock_guard<std::mutex> lock(this->mutex);
+   if ((generation != this->generation) || (this->entries.count(path) > 0))
+   {
+      return file;
+   }
+   const size_t fileSize = m_get_size(*file);
+   this->evict(fileSize);
+   if ((this->size + fileSize) <= this->budget)
+   {
+      Entry& entry = this->entries[path];
+      entry.file = file;
+      this->lru.push_front(path);
+      entry.lru = this->lru.begin();
+      this->size += fileSize;
+   }
+   return file;
+}
+
+
+void StaticCache::processEvents()
+{
+   union
+   {
+      struct inotify_event event;
+      char buffer[4096];
+   } events;
+   ssize_t len;
+
+   lock_guard<std::mutex> lock(this->mutex);
+   if (this->inotifyFd < 0)
+   {
+      return;
+   }
+
+   //read until drained (edge-triggered)
+   while ((len = ::read(this->inotifyFd, events.buffer, sizeof(events.buffer))) > 0)
+   {
+      for (char * ptr = events.buffer; ptr < (events.buffer + len); )
+      {
+         const struct inotify_event * event = (const struct inotify_event *)ptr;
+         ptr += sizeof(struct inotify_event) + event->len;
+         this->generation++;
+
+         //events got lost -> drop everything
+         if (event->mask & IN_Q_OVERFLOW)
+         {
+            this->entries.clear();
+            this->lru.clear();
+            this->size = 0;
+            continue;
+         }
+
+         unordered_map<int, string>::iterator dir = this->directories.find(event->wd);
+         if (dir == this->directories.end())
+         {
+            continue;
+         }
+
+         //directory itself was deleted or moved
+         if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+         {
+            this->invalidateDirectory(dir->second);
+            if (event->mask & IN_IGNORED) //watch was removed by the kernel
+            {
+               this->watches.erase(dir->second);
+               this->directories.erase(dir);
+            }
+            continue;
+         }
+
+         //file within the directory was changed
+         //a changed precompressed sibling (e.g. file.gz) invalidates the file, too
+         if (event->len > 0)
+         {
+            const string path = dir->second + "/" + event->name;
+            this->invalidate(path);
+            for (int i = 0; i < Compression::ENCODINGS; ++i)
+            {
+               const size_t suffixLen = strlen(Compression::getSuffix((Compression::Encoding)i));
+               if ((path.length() > suffixLen) && (path.compare(path.length() - suffixLen, suffixLen, Compression::getSuffix((Compression::Encoding)i)) == 0))
+               {
+                  this->invalidate(path.substr(0, path.length() - suffixLen));
+               }
+            }
+         }
+      }
+   }
+}
+
+
+StaticFilePtr StaticCache::load(const string& path, const string& contentType, int * fd)
+{
+   //hidden files (compared by resolved path; only files read from the file system are checked, thus hidden ones never get cached)
+   char resolved[PATH_MAX];
+   *fd = -1;
+   if (!this->hidden.empty() && (realpath(path.c_str(), resolved) != NULL) && (this->hidden.count(resolved) > 0))
+   {
+      return StaticFilePtr();
+   }
+
+   shared_ptr<StaticFile> file = this->read(path, fd);
+   if (!file)
+   {
+      return file;
+   }
+
+   //precompressed siblings (only if small enough to be held in memory)
+   string vary;
+   for (int i = 0; i < Compression::ENCODINGS; ++i)
+   {
+      const Compression::Encoding encoding = (Compression::Encoding)i;
+      int siblingFd;
+      shared_ptr<StaticFile> sibling = this->read(path + Compression::getSuffix(encoding), &siblingFd);
+      if (siblingFd >= 0)
+      {
+         ::close(siblingFd);
+         continue;
+      }
+      if (sibling)
+      {
+         string header = "HTTP/1.1 200 OK\r\n";
+         header += "Content-Type: " + contentType + "\r\n";
+         header += "Content-Encoding: " + string(Compression::getName(encoding)) + "\r\n";
+         header += "Vary: Accept-Encoding\r\n";
+         header += "Content-Length: " + to_string(sibling->length) + "\r\n";
+         sibling->header[0] = header + "Connection: close\r\n\r\n";
+         sibling->header[1] = header + "Connection: keep-alive\r\n\r\n";
+         file->encoded[i] = sibling;
+         vary = "Vary: Accept-Encoding\r\n";
+      }
+   }
+
+   //render header
+   string header = "HTTP/1.1 200 OK\r\n";
+   header += "Content-Type: " + contentType + "\r\n";
+   header += vary;
+   header += "Content-Length: " + to_string(file->length) + "\r\n";
+   file->header[0] = header + "Connection: close\r\n\r\n";
+   file->header[1] = header + "Connection: keep-alive\r\n\r\n";
+   return file;
+}
+
+
+//read a file (without header), or open it for streaming (if larger than maxFileSize)
+shared_ptr<StaticFile> StaticCache::read(const string& path, int * fd)
+{
+   struct stat info;
+   int file_fd;
+
+   *fd = -1;
+   file_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (file_fd < 0)
+   {
+      return shared_ptr<StaticFile>();
+   }
+   if ((fstat(file_fd, &info) < 0) || !S_ISREG(info.st_mode))
+   {
+      ::close(file_fd);
+      return shared_ptr<StaticFile>();
+   }
+
+   shared_ptr<StaticFile> file = make_shared<StaticFile>();
+   file->length = (uint64_t)info.st_size;
+   if (file->length > this->maxFileSize) //too large -> shall be streamed by caller
+   {
+      *fd = file_fd;
+   }
+   else //read file content
+   {
+      file->content.resize((size_t)file->length);
+      size_t done = 0;
+      while (done < file->content.length())
+      {
+         ssize_t status = ::read(file_fd, &file->content[done], file->content.length() - done);
+         if (status < 0)
+         {
+            if (errno == EINTR) continue;
+            ::close(file_fd);
+            return shared_ptr<StaticFile>();
+         }
+         if (status == 0) //file was truncated meanwhile
+         {
+            file->content.resize(done);
+            break;
+         }
+         done += (size_t)status;
+      }
+      ::close(file_fd);
+      file->length = file->content.length();
+   }
+   return file;
+}
+
+
+bool StaticCache::watch(const string& directory)
+{
+   if (this->watches.count(directory) > 0)
+   {
+      return true;
+   }
+   int wd = inotify_add_watch(this->inotifyFd, directory.c_str(), WATCH_EVENTS);
+   if (wd < 0)
+   {
+      return false;
+   }
+   this->watches[directory] = wd;
+   this->directories[wd] = directory;
+   return true;
+}
+
+
+void StaticCache::invalidate(const string& path)
+{
+   unordered_map<string, Entry>::iterator it = this->entries.find(path);
+   if (it != this->entries.end())
+   {
+      this->size -= m_get_size(*it->second.file);
+      this->lru.erase(it->second.lru);
+      this->entries.erase(it);
+   }
+}
+
+
+void StaticCache::invalidateDirectory(const string& directory)
+{
+   const string prefix = directory + "/";
+   unordered_map<string, Entry>::iterator it = this->entries.begin();
+   while (it != this->entries.end())
+   {
+      const string& path = (it++)->first;
+      if (path.compare(0, prefix.length(), prefix) == 0)
+      {
+         this->invalidate(path);
+      }
+   }
+}
+
+
+//evict least recently used entries, until the required number of bytes fits into the budget
+void StaticCache::evict(size_t required)
+{
+   while (!this->lru.empty() && ((this->size + required) > this->budget))
+   {
+      this->invalidate(this->lru.back());
+   }
+}
+
+
+//number of bytes held by a cached file (including its precompressed siblings)
+static size_t m_get_size(const StaticFile& file)
+{
+   size_t size = file.content.length() + file.header[0].length() + file.header[1].length();
+   for (int i = 0; i < Compression::ENCODINGS; ++i)
+   {
+      if (file.encoded[i])
+      {
+         size += m_get_size(*file.encoded[i]);
+      }
+   }
+   return size;
+}
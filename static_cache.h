@@ -0,0 +1,113 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief In-memory cache of static files, invalidated by inotify
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef STATIC_CACHE_H_INCLUDED
+#define STATIC_CACHE_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "compression.h"
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+class EventLoop;
+
+
+//a static file, together with its pre-rendered response header
+//instances are immutable; they stay valid as long as they are referenced, even if evicted from the cache
+class StaticFile
+{
+public:
+   std::string header[2]; //response header (incl. terminating empty line); [0]: "Connection: close", [1]: "Connection: keep-alive"
+   std::string content; //empty, if the file is streamed (see StaticCache::get)
+   uint64_t length; //length of file
+   std::shared_ptr<const StaticFile> encoded[Compression::ENCODINGS]; //precompressed siblings (e.g. file.gz); NULL if there is none
+};
+
+typedef std::shared_ptr<const StaticFile> StaticFilePtr;
+
+
+//bounded, least recently used cache of static files (shared by all workers)
+//changes of the cached files are detected by inotify, so cache hits never access the file system
+class StaticCache
+{
+public:
+   //budget: max. number of bytes held by the cache (0 disables caching)
+   //files larger than maxFileSize are never cached, nor read (they are streamed, see get)
+   StaticCache(size_t budget, size_t maxFileSize);
+   ~StaticCache();
+
+   //create the inotify instance; caching is disabled if that fails
+   //returns file descriptor to be watched for readability; -1 in case of errors
+   int open();
+   void close();
+
+   //register the inotify descriptor with an event loop (the cache is reported as context)
+   void attach(EventLoop& eventLoop);
+
+   //never serve the given file, however its path is spelled (e.g. "//file", "/./file" or through symlinks)
+   //the file need not exist yet, but its directory must. call before files are requested
+   void hide(const std::string& path);
+
+   //get file from cache; reads it from the file system on a cache miss
+   //files larger than maxFileSize are not read. Instead fd is set to an open descriptor of the file,
+   //that shall be streamed by the caller (who must close it). Otherwise fd is set to -1
+   //(for such files only the header and the precompressed siblings are cached)
+   //precompressed siblings of the file (file.br, file.gz; up to maxFileSize) are read together with the file
+   //contentType is only used to render the header of a file, not yet cached
+   //returns NULL if the file doesn't exist (or is no regular file)
+   StaticFilePtr get(const std::string& path, const std::string& contentType, int * fd);
+
+   //process pending inotify events, invalidating the affected entries (call when the descriptor is readable)
+   void processEvents();
+
+private:
+   typedef struct
+   {
+      StaticFilePtr file;
+      std::list<std::string>::iterator lru; //position within the LRU list
+   } Entry;
+
+   StaticFilePtr load(const std::string& path, const std::string& contentType, int * fd);
+   std::shared_ptr<StaticFile> read(const std::string& path, int * fd);
+   bool watch(const std::string& directory);
+   void invalidate(const std::string& path);
+   void invalidateDirectory(const std::string& directory);
+   void evict(size_t required);
+
+   std::mutex mutex; //protects all members below
+   size_t budget;
+   size_t maxFileSize;
+   size_t size; //number of bytes currently held
+   uint64_t generation; //incremented with every inotify event
+   std::unordered_map<std::string, Entry> entries; //by path
+   std::list<std::string> lru; //paths, most recently used first
+   int inotifyFd;
+   std::unordered_map<int, std::string> directories; //watched directories, by watch descriptor
+   std::unordered_map<std::string, int> watches; //watch descriptors, by directory
+   std::unordered_set<std::string> hidden; //resolved paths of files, that are never served
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // STATIC_CACHE_H_INCLUDED
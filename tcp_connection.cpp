@@ -14,9 +14,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include "tcp_connection.h"
 
 
@@ -24,6 +27,8 @@
 
 using namespace std;
 
+#define MAX_IOV   64 //max. number of queued segments sent at once (writev)
+
 
 /* -- Types --------------------------------------------------------------- */
 
@@ -38,6 +43,7 @@ NbTcpConnection::NbTcpConnection()
 {
    this->sock = -1;
    memset(&this->address, 0, sizeof(this->address));
+   this->pending = 0;
 }
 
 
@@ -45,6 +51,13 @@ NbTcpConnection::NbTcpConnection(int sock, const struct sockaddr_in * address)
 {
    this->sock = sock;
    this->address = *address;
+   this->pending = 0;
+}
+
+
+NbTcpConnection::~NbTcpConnection()
+{
+   this->close();
 }
 
 
@@ -54,6 +67,20 @@ bool NbTcpConnection::isOpen()
 }
 
 
+void NbTcpConnection::attach(int sock, const struct sockaddr_in * address)
+{
+   this->sock = sock;
+   this->address = *address;
+   this->pending = 0;
+}
+
+
+int NbTcpConnection::getSocket() const
+{
+   return this->sock;
+}
+
+
 int NbTcpConnection::recv(uint8_t * buffer, size_t bufferLen)
 {
    int status;
@@ -87,29 +114,247 @@ int NbTcpConnection::recv(uint8_t * buffer, size_t bufferLen)
 
 int NbTcpConnection::send(const uint8_t * data, size_t dataLen, bool more)
 {
-   int flags = (more ? MSG_MORE : 0);
-   int status;
+   struct iovec iov;
+   iov.iov_base = (void *)data;
+   iov.iov_len = dataLen;
+   return this->queue(shared_ptr<const void>(), &iov, 1, more);
+}
+
+
+int NbTcpConnection::send(const shared_ptr<const void>& owner, const uint8_t * data, size_t dataLen, bool more)
+{
+   struct iovec iov;
+   iov.iov_base = (void *)data;
+   iov.iov_len = dataLen;
+   return this->queue(owner, &iov, 1, more);
+}
+
+
+int NbTcpConnection::send(const shared_ptr<const void>& owner, const struct iovec * iov, int iovCount, bool more)
+{
+   return this->queue(owner, iov, iovCount, more);
+}
+
+
+long NbTcpConnection::sendFile(int fd, off_t offset, size_t count)
+{
+   OutputSegment segment;
 
    //check
    if (this->sock < 0)
    {
       cout << "Failed to send to closed connection!" << endl;
+      ::close(fd);
       return -1;
    }
 
-   //Send some data
-   status = ::send(this->sock, data, dataLen, flags);
-   if (status < 0)
+   //queue file and send as much as possible
+   segment.data = NULL;
+   segment.length = count;
+   segment.fd = fd;
+   segment.offset = offset;
+   this->output.push_back(segment);
+   this->pending += count;
+   if (this->flush() < 0)
    {
-      cout << "Failed to send data to server!" << endl;
       return -1;
    }
-   return status;
+   return (long)count;
+}
+
+
+long NbTcpConnection::flush()
+{
+   struct iovec iov[MAX_IOV];
+   ssize_t status;
+
+   //check
+   if (this->sock < 0)
+   {
+      return -1;
+   }
+
+   while (!this->output.empty())
+   {
+      OutputSegment& front = this->output.front();
+
+      //file segment
+      if (front.fd >= 0)
+      {
+         status = ::sendfile(this->sock, front.fd, &front.offset, front.length);
+         if (status == 0) //end of file (file was truncated meanwhile). the promised length can't be sent
+         {
+            cout << "Failed to send file!" << endl;
+            return -1;
+         }
+      }
+      //memory segments - send as many of them at once as possible
+      else
+      {
+         struct msghdr message = { 0 };
+         size_t count = 0;
+         for (size_t i = 0; (i < this->output.size()) && (count < MAX_IOV); ++i)
+         {
+            const OutputSegment& segment = this->output[i];
+            if (segment.fd >= 0)
+            {
+               break;
+            }
+            iov[count].iov_base = (void *)segment.data;
+            iov[count].iov_len = segment.length;
+            count++;
+         }
+         message.msg_iov = iov;
+         message.msg_iovlen = count;
+         status = ::sendmsg(this->sock, &message, MSG_NOSIGNAL);
+      }
+
+      if (status < 0)
+      {
+         if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) //socket buffer is full
+         {
+            break;
+         }
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         cout << "Failed to send data!" << endl;
+         return -1;
+      }
+
+      //remove sent data from output queue
+      size_t sent = (size_t)status;
+      this->pending -= sent;
+      while (sent > 0)
+      {
+         OutputSegment& segment = this->output.front();
+         const size_t len = (sent < segment.length) ? sent : segment.length;
+         segment.length -= len;
+         sent -= len;
+         if (segment.fd < 0)
+         {
+            segment.data += len; //(offset of file segments is advanced by sendfile)
+         }
+         if (segment.length == 0)
+         {
+            if (segment.fd >= 0)
+            {
+               ::close(segment.fd);
+            }
+            this->output.pop_front();
+         }
+      }
+   }
+   return (long)this->pending;
+}
+
+
+size_t NbTcpConnection::getPending() const
+{
+   return this->pending;
+}
+
+
+int NbTcpConnection::setKeepAlive(int idle, int interval, int count)
+{
+   const int enable = 1;
+   if ((setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0) ||
+       (setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) < 0) ||
+       (setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) < 0))
+   {
+      return -1;
+   }
+   return setsockopt(this->sock, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+}
+
+
+int NbTcpConnection::queue(const shared_ptr<const void>& owner, const struct iovec * iov, int iovCount, bool more)
+{
+   int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+   ssize_t status = 0;
+   size_t dataLen = 0;
+
+   //check
+   if (this->sock < 0)
+   {
+      cout << "Failed to send to closed connection!" << endl;
+      return -1;
+   }
+
+   for (int i = 0; i < iovCount; ++i)
+   {
+      dataLen += iov[i].iov_len;
+   }
+
+   //Send some data (directly, if nothing is queued)
+   if (this->output.empty())
+   {
+      struct msghdr message = { 0 };
+      message.msg_iov = (struct iovec *)iov;
+      message.msg_iovlen = (size_t)iovCount;
+      status = ::sendmsg(this->sock, &message, flags);
+      if (status < 0)
+      {
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) //socket buffer is full
+         {
+            cout << "Failed to send data to server!" << endl;
+            return -1;
+         }
+         status = 0;
+      }
+   }
+
+   //queue what remains
+   size_t sent = (size_t)status;
+   for (int i = 0; i < iovCount; ++i)
+   {
+      const uint8_t * data = (const uint8_t *)iov[i].iov_base;
+      size_t length = iov[i].iov_len;
+      if (sent >= length) //region was sent completely
+      {
+         sent -= length;
+         continue;
+      }
+      data += sent;
+      length -= sent;
+      sent = 0;
+
+      OutputSegment segment;
+      this->output.push_back(segment);
+      OutputSegment& queued = this->output.back();
+      queued.owner = owner;
+      queued.fd = -1;
+      queued.offset = 0;
+      queued.length = length;
+      if (owner) //shared data
+      {
+         queued.data = data;
+      }
+      else //copy data
+      {
+         queued.copy.assign((const char *)data, length);
+         queued.data = (const uint8_t *)queued.copy.data();
+      }
+      this->pending += length;
+   }
+   return (int)dataLen;
 }
 
 
 void NbTcpConnection::close()
 {
+   //drop unsent data
+   while (!this->output.empty())
+   {
+      if (this->output.front().fd >= 0)
+      {
+         ::close(this->output.front().fd);
+      }
+      this->output.pop_front();
+   }
+   this->pending = 0;
+
    if (this->sock >= 0)
    {
       ::shutdown(this->sock, SHUT_RD); //block until all queued bytes are sent!!!
@@ -134,16 +379,23 @@ NbTcpServer::NbTcpServer()
 }
 
 
-int NbTcpServer::open(const uint16_t port)
+int NbTcpServer::open(const uint16_t port, bool reusePort, int backlog)
 {
    struct sockaddr_in address = { 0 };
    int status;
    int sock;
 
-   //create TCP socket
-   sock = socket(AF_INET, SOCK_STREAM, 0);
+   //create non-blocking TCP socket
+   sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
    if (sock >= 0)
    {
+      //let the kernel balance incomming connections among all servers of that port
+      if (reusePort)
+      {
+         int enable = 1;
+         setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+      }
+
       //bind socket to given port
       address.sin_family = AF_INET;
       address.sin_port = htons(port);
@@ -152,13 +404,9 @@ int NbTcpServer::open(const uint16_t port)
       if (status >= 0)
       {
          //start to listen
-         status = ::listen(sock, 3); //backlog of 3
+         status = ::listen(sock, backlog);
          if (status >= 0)
          {
-            //make socket non-blocking
-            fcntl(sock, F_SETFL, O_NONBLOCK);
-
-            //
             this->sock = sock;
             this->address = address;
             return sock;
@@ -186,12 +434,10 @@ NbTcpConnection * NbTcpServer::serve()
       return NULL;
    }
 
-   //test for incomming connections
-   connection = ::accept(this->sock, (struct sockaddr *)&address, &addressSize);
+   //test for incomming connections (non-blocking without further system calls)
+   connection = ::accept4(this->sock, (struct sockaddr *)&address, &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
    if (connection >= 0)
    {
-      //make socket non-blocking
-      fcntl(connection, F_SETFL, O_NONBLOCK);
       //return connection instance
       return new NbTcpConnection(connection, &address);
    }
@@ -199,6 +445,40 @@ NbTcpConnection * NbTcpServer::serve()
 }
 
 
+int NbTcpServer::serve(NbTcpConnection& connection)
+{
+   struct sockaddr_in address = { 0 };
+   socklen_t addressSize = sizeof(address);
+   int sock;
+
+   //check
+   if (this->sock < 0)
+   {
+      cout << "Failed to serve on closed connection!" << endl;
+      return -1;
+   }
+
+   sock = ::accept4(this->sock, (struct sockaddr *)&address, &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+   if (sock >= 0)
+   {
+      connection.attach(sock, &address);
+   }
+   return sock;
+}
+
+
+int NbTcpServer::setDeferAccept(int seconds)
+{
+   return setsockopt(this->sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds));
+}
+
+
+int NbTcpServer::setFastOpen(int queueLength)
+{
+   return setsockopt(this->sock, IPPROTO_TCP, TCP_FASTOPEN, &queueLength, sizeof(queueLength));
+}
+
+
 
 //-----------------------------------------------------------------------------------
 
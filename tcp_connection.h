@@ -9,32 +9,91 @@
 
 /* -- Includes ------------------------------------------------------------ */
 #include <stdint.h>
+#include <string>
+#include <deque>
+#include <memory>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
 
 
 
 /* -- Defines ------------------------------------------------------------- */
 
 /* -- Types --------------------------------------------------------------- */
+//segment of the output queue of a connection
+//either a memory region (copied, or kept alive by its owner) or a file region (sent by sendfile)
+typedef struct
+{
+   std::shared_ptr<const void> owner; //keeps data alive until sent; NULL for copied data
+   std::string copy; //copied data
+   const uint8_t * data; //start of unsent data (memory segment)
+   size_t length; //number of unsent bytes
+   int fd; //file descriptor (file segment); -1 for memory segments. closed, when the segment was sent
+   off_t offset; //position of next byte to be sent (file segment)
+} OutputSegment;
+
+
 class NbTcpConnection
 {
 public:
    NbTcpConnection();
    NbTcpConnection(int sock, const struct sockaddr_in * address);
+   ~NbTcpConnection();
 
    bool isOpen();
 
+   //take over an accepted socket (the connection must be closed)
+   void attach(int sock, const struct sockaddr_in * address);
+
+   //returns file descriptor of socket (e.g. to register it with an event loop); -1 when closed
+   int getSocket() const;
+
    //returns number of received data bytes; 0 when nothing was received; -1 in case of connection errors
    int recv(uint8_t * buffer, size_t bufferLen);
 
-   //returns number of sent data bytes; -1 in case of connection errors
+   //data, that can't be sent immediately, is copied to the output queue (see flush)
+   //returns number of accepted data bytes (dataLen); -1 in case of connection errors
    int send(const uint8_t * data, size_t dataLen, bool more=false);
 
+   //same as above, but data, that can't be sent immediately, is queued without copying
+   //owner keeps the data alive until it was sent
+   int send(const std::shared_ptr<const void>& owner, const uint8_t * data, size_t dataLen, bool more=false);
+
+   //same as above, but several memory regions (all kept alive by owner) are sent at once (writev)
+   //returns number of accepted data bytes (sum of all regions); -1 in case of connection errors
+   int send(const std::shared_ptr<const void>& owner, const struct iovec * iov, int iovCount, bool more=false);
+
+   //send count bytes of a file, starting at offset, without copying them to user space (sendfile)
+   //takes ownership of fd - it is closed when the file was sent (or the connection is closed)
+   //returns number of accepted data bytes (count); -1 in case of connection errors
+   long sendFile(int fd, off_t offset, size_t count);
+
+   //send as much of the output queue as the socket accepts; call whenever the socket becomes writable
+   //returns number of bytes still queued; -1 in case of connection errors
+   long flush();
+
+   //returns number of bytes queued for sending
+   size_t getPending() const;
+
+   //probe the peer after idle seconds without traffic, every interval seconds, count times (SO_KEEPALIVE)
+   //a peer, that doesn't answer (e.g. crashed host, half-open connection), is reported as connection error
+   //returns 0 on success; -1 in case of errors
+   int setKeepAlive(int idle, int interval, int count);
+
    void close();
 
 protected:
    int sock; //file descriptor of socket
    struct sockaddr_in address; //remote connection address
+
+private:
+   NbTcpConnection(const NbTcpConnection&); //non-copyable (owns output queue)
+   int queue(const std::shared_ptr<const void>& owner, const struct iovec * iov, int iovCount, bool more);
+
+   std::deque<OutputSegment> output; //data not yet sent
+   size_t pending; //number of bytes within output queue
 };
 
 
@@ -45,13 +104,30 @@ public:
    NbTcpServer();
 
    //open a non blocking tcp server connection, listening to the given port
+   //with reusePort set, several servers (e.g. one per thread) may listen to the same port (SO_REUSEPORT)
+   //backlog is the max. number of connections, waiting to be accepted (capped by net.core.somaxconn)
    //returns positive number on success; -1 in case of errors
-   int open(const uint16_t port);
+   int open(const uint16_t port, bool reusePort=false, int backlog=SOMAXCONN);
+
+   //connections are only reported as acceptable once data was received on them (TCP_DEFER_ACCEPT)
+   //connections not sending data within the given time (in s) are dropped by the kernel
+   //returns 0 on success; -1 in case of errors
+   int setDeferAccept(int seconds);
 
-   //call this function cyclically to accept incomming connections
+   //accept data within the SYN of clients, knowing a TFO cookie (TCP_FASTOPEN)
+   //queueLength is the max. number of pending TFO requests
+   //returns 0 on success; -1 in case of errors
+   int setFastOpen(int queueLength);
+
+   //accept an incomming connection; call repeatedly until NULL is returned (edge-triggered readiness)
+   //accepted sockets are non-blocking and close-on-exec right away (accept4)
    //returns pointer to accepted connection; NULL otherwise
    NbTcpConnection * serve();
 
+   //same as above, but the accepted socket is attached to the given (closed) connection, without allocating one
+   //returns socket of the accepted connection; -1 otherwise
+   int serve(NbTcpConnection& connection);
+
 private:
 };
 
@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Test of xcrc32: the byte-wise, slice-by-8 and PCLMULQDQ paths must produce identical CRCs
+
+   Usage: crc32_test [rounds]
+*/
+//-----------------------------------------------------------------------------
+
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../crc32.c" //(the paths are module global)
+
+/* -- Defines ------------------------------------------------------------- */
+#define MAX_LENGTH   4096 //of most buffers (some are longer, see main)
+#define MAX_OFFSET   64 //alignments of the buffers tested
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Module Global Variables --------------------------------------------- */
+static uint32_t state = 2463534242u; //of the random number generator
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static uint32_t random32(void);
+static int check(const unsigned char * buf, size_t len, unsigned int init);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+int main(int argc, const char * argv[])
+{
+   const unsigned rounds = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 10) : 20000;
+   const size_t size = MAX_OFFSET + (1024 * 1024);
+   unsigned char * data = (unsigned char *)malloc(size);
+   unsigned failures = 0;
+   unsigned i;
+
+   if (data == NULL)
+   {
+      return 1;
+   }
+   for (i = 0; i < size; ++i)
+   {
+      data[i] = (unsigned char)random32();
+   }
+
+   //check value of the CRC (CRC-32/MPEG-2, as computed by xcrc32 with an initial value of 0xFFFFFFFF)
+   if (xcrc32((const unsigned char *)"123456789", 9, 0xFFFFFFFFu) != 0x0376E6E7u)
+   {
+      printf("check value mismatch: %08x\n", xcrc32((const unsigned char *)"123456789", 9, 0xFFFFFFFFu));
+      failures++;
+   }
+
+   //all lengths around the block sizes of the paths (8, 16, 64 and 128 bytes), at all alignments
+   for (i = 0; i < (MAX_OFFSET * 300); ++i)
+   {
+      failures += check(&data[i % MAX_OFFSET], i / MAX_OFFSET, random32());
+   }
+
+   //random lengths and alignments; every 64th buffer is long
+   for (i = 0; i < rounds; ++i)
+   {
+      const size_t maxLength = ((i % 64) == 0) ? (size - MAX_OFFSET) : MAX_LENGTH;
+      failures += check(&data[random32() % MAX_OFFSET], random32() % (maxLength + 1), random32());
+   }
+
+   free(data);
+   printf("%u failures (%s path in use)\n", failures,
+#ifdef CRC32_CLMUL_X86
+          (crc32_impl == crc32_clmul) ? "PCLMULQDQ" :
+#endif
+          "slice-by-8");
+   return (failures == 0) ? 0 : 1;
+}
+
+
+//compare the CRC of the buffer computed by all paths (the byte-wise one being the reference)
+//returns the number of paths, whose CRC differs
+static int check(const unsigned char * buf, size_t len, unsigned int init)
+{
+   const unsigned int expected = crc32_bytewise(buf, len, init);
+   int failures = 0;
+
+   if (crc32_sliced(buf, len, init) != expected)
+   {
+      printf("slice-by-8 mismatch: length %u, offset %u\n", (unsigned)len, (unsigned)((uintptr_t)buf % MAX_OFFSET));
+      failures++;
+   }
+#ifdef CRC32_CLMUL_X86
+   if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3") && (crc32_clmul(buf, len, init) != expected))
+   {
+      printf("PCLMULQDQ mismatch: length %u, offset %u\n", (unsigned)len, (unsigned)((uintptr_t)buf % MAX_OFFSET));
+      failures++;
+   }
+#endif
+   if (xcrc32(buf, (int)len, init) != expected)
+   {
+      printf("xcrc32 mismatch: length %u, offset %u\n", (unsigned)len, (unsigned)((uintptr_t)buf % MAX_OFFSET));
+      failures++;
+   }
+   return failures;
+}
+
+
+//xorshift32
+static uint32_t random32(void)
+{
+   state ^= state << 13;
+   state ^= state >> 17;
+   state ^= state << 5;
+   return state;
+}
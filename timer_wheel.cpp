@@ -0,0 +1,229 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief Hierarchical timer wheel (O(1) arming, cancelling and expiry of timers)
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include "timer_wheel.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+#define MAX_DELAY   ((1ull << (LEVELS * SLOT_BITS)) - 1) //max. delay, that can be sorted in (longer ones are cascaded again)
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+TimerWheel::TimerWheel(uint64_t now)
+{
+   for (unsigned i = 0; i <= EXPIRED; ++i)
+   {
+      this->slots[i].prev = &this->slots[i];
+      this->slots[i].next = &this->slots[i];
+   }
+   for (unsigned i = 0; i < LEVELS; ++i)
+   {
+      this->occupied[i] = 0;
+   }
+   this->current = now;
+}
+
+
+void TimerWheel::init(Timer * timer, void * context)
+{
+   timer->prev = NULL;
+   timer->next = NULL;
+   timer->expiry = 0;
+   timer->context = context;
+   timer->slot = 0;
+}
+
+
+bool TimerWheel::isArmed(const Timer * timer)
+{
+   return (timer->next != NULL);
+}
+
+
+void TimerWheel::arm(Timer * timer, uint64_t expiry)
+{
+   this->unlink(timer);
+   //slots up to the current time have already been processed -> expire with the next one
+   timer->expiry = (expiry > this->current) ? expiry : (this->current + 1);
+   this->link(timer);
+}
+
+
+void TimerWheel::cancel(Timer * timer)
+{
+   this->unlink(timer);
+}
+
+
+Timer * TimerWheel::expire(uint64_t now)
+{
+   Timer * expired = &this->slots[EXPIRED];
+
+   //process the wheel up to now, skipping empty slots
+   while (expired->next == expired)
+   {
+      const uint64_t next = this->getNext();
+      if (next > now)
+      {
+         if (now > this->current)
+         {
+            this->current = now;
+         }
+         return NULL;
+      }
+      this->current = next - 1;
+      this->step();
+   }
+
+   Timer * timer = expired->next;
+   this->unlink(timer);
+   return timer;
+}
+
+
+int TimerWheel::getTimeout(uint64_t now) const
+{
+   if (this->slots[EXPIRED].next != &this->slots[EXPIRED])
+   {
+      return 0;
+   }
+   const uint64_t next = this->getNext();
+   if (next == UINT64_MAX)
+   {
+      return -1;
+   }
+   if (next <= now)
+   {
+      return 0;
+   }
+   return ((next - now) > INT32_MAX) ? INT32_MAX : (int)(next - now);
+}
+
+
+//sort timer into the level, whose slots cover its delay
+void TimerWheel::link(Timer * timer)
+{
+   uint64_t expiry = (timer->expiry > this->current) ? timer->expiry : this->current; //due while cascading -> current slot
+   uint64_t delay = expiry - this->current;
+   if (delay > MAX_DELAY)
+   {
+      delay = MAX_DELAY;
+      expiry = this->current + MAX_DELAY;
+   }
+
+   unsigned level = 0;
+   while ((delay >> ((level + 1) * SLOT_BITS)) != 0)
+   {
+      ++level;
+   }
+   const unsigned index = (unsigned)(expiry >> (level * SLOT_BITS)) & (SLOTS - 1);
+   Timer * head = &this->slots[(level * SLOTS) + index];
+
+   timer->prev = head->prev;
+   timer->next = head;
+   head->prev->next = timer;
+   head->prev = timer;
+   timer->slot = (uint16_t)((level * SLOTS) + index);
+   this->occupied[level] |= (1ull << index);
+}
+
+
+void TimerWheel::unlink(Timer * timer)
+{
+   if (timer->next == NULL)
+   {
+      return;
+   }
+   timer->prev->next = timer->next;
+   timer->next->prev = timer->prev;
+   timer->prev = NULL;
+   timer->next = NULL;
+
+   //slot ran empty -> clear its bit
+   Timer * head = &this->slots[timer->slot];
+   if ((timer->slot < EXPIRED) && (head->next == head))
+   {
+      this->occupied[timer->slot / SLOTS] &= ~(1ull << (timer->slot % SLOTS));
+   }
+}
+
+
+//move the timers of the current slot of the given level to the lower levels
+void TimerWheel::cascade(unsigned level)
+{
+   const unsigned index = (unsigned)(this->current >> (level * SLOT_BITS)) & (SLOTS - 1);
+   Timer * head = &this->slots[(level * SLOTS) + index];
+   while (head->next != head)
+   {
+      Timer * timer = head->next;
+      this->unlink(timer);
+      this->link(timer);
+   }
+}
+
+
+//advance the wheel by 1 ms: cascade upper levels (whenever the lower level wraps), then expire the current slot of level 0
+void TimerWheel::step()
+{
+   ++this->current;
+   for (unsigned level = 1; level < LEVELS; ++level)
+   {
+      if (((this->current >> ((level - 1) * SLOT_BITS)) & (SLOTS - 1)) != 0)
+      {
+         break;
+      }
+      this->cascade(level);
+   }
+
+   Timer * head = &this->slots[this->current & (SLOTS - 1)];
+   Timer * expired = &this->slots[EXPIRED];
+   while (head->next != head)
+   {
+      Timer * timer = head->next;
+      this->unlink(timer);
+      timer->prev = expired->prev;
+      timer->next = expired;
+      expired->prev->next = timer;
+      expired->prev = timer;
+      timer->slot = EXPIRED;
+   }
+}
+
+
+//time of the next slot with timers (the time it expires or is cascaded at); UINT64_MAX if no timer is armed
+uint64_t TimerWheel::getNext() const
+{
+   uint64_t next = UINT64_MAX;
+   for (unsigned level = 0; level < LEVELS; ++level)
+   {
+      if (this->occupied[level] == 0)
+      {
+         continue;
+      }
+      //find first non-empty slot following the current one (rotate the bitmap)
+      const unsigned shift = level * SLOT_BITS;
+      const uint64_t base = (this->current >> shift) + 1;
+      const unsigned start = (unsigned)base & (SLOTS - 1);
+      const uint64_t rotated = (this->occupied[level] >> start) | (this->occupied[level] << ((SLOTS - start) & (SLOTS - 1)));
+      const uint64_t time = (base + __builtin_ctzll(rotated)) << shift;
+      if (time < next)
+      {
+         next = time;
+      }
+   }
+   return next;
+}
@@ -0,0 +1,84 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief Hierarchical timer wheel (O(1) arming, cancelling and expiry of timers)
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef TIMER_WHEEL_H_INCLUDED
+#define TIMER_WHEEL_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+//intrusive timer node, embedded into its owner (e.g. a connection)
+struct Timer
+{
+   Timer * prev;
+   Timer * next;
+   uint64_t expiry; //time (in ms), the timer expires at
+   void * context; //owner of the timer
+   uint16_t slot; //slot of the wheel, the timer is linked into
+};
+
+
+//timers are sorted into 4 levels of 64 slots each. level 0 has a resolution of 1 ms, each further
+//level a 64 times coarser one (up to ~4.6 hours). timers of a slot of an upper level are moved
+//(cascaded) to the lower levels, once the time reaches that slot
+class TimerWheel
+{
+public:
+   //now: current time in ms
+   TimerWheel(uint64_t now);
+
+   static void init(Timer * timer, void * context);
+   static bool isArmed(const Timer * timer);
+
+   //(re-)arm the timer to expire at the given time in ms
+   void arm(Timer * timer, uint64_t expiry);
+
+   //disarm the timer (no-op if not armed)
+   void cancel(Timer * timer);
+
+   //remove and return a timer, that has expired until now; NULL if there is none
+   Timer * expire(uint64_t now);
+
+   //time in ms until the next timer expires (or timers must be cascaded); -1 if no timer is armed
+   int getTimeout(uint64_t now) const;
+
+private:
+   enum
+   {
+      LEVELS = 4,
+      SLOT_BITS = 6,
+      SLOTS = 1 << SLOT_BITS,
+      EXPIRED = LEVELS * SLOTS, //slot of the expired timers
+   };
+
+   TimerWheel(const TimerWheel&); //non-copyable (sentinels are referenced by their nodes)
+   void link(Timer * timer);
+   void unlink(Timer * timer);
+   void cascade(unsigned level);
+   void step();
+   uint64_t getNext() const;
+
+   Timer slots[EXPIRED + 1]; //sentinels of the slot lists
+   uint64_t occupied[LEVELS]; //bitmap of the non-empty slots, per level
+   uint64_t current; //time, up to which the wheel has been processed
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // TIMER_WHEEL_H_INCLUDED
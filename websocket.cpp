@@ -0,0 +1,261 @@
+//-----------------------------------------------------------------------------
+/*!
+   \file
+   \brief WebSocket (RFC 6455) opening handshake and framing
+*/
+//-----------------------------------------------------------------------------
+
+/* -- Includes ------------------------------------------------------------ */
+#include <string.h>
+#include "websocket.h"
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+using namespace std;
+
+#define GUID   "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" //appended to the key of the opening handshake
+
+#define ROL(x, n)   (((x) << (n)) | ((x) >> (32 - (n))))
+
+
+/* -- Types --------------------------------------------------------------- */
+
+/* -- (Module) Global Variables ------------------------------------------- */
+
+/* -- Module Global Function Prototypes ----------------------------------- */
+static void m_sha1(const uint8_t * data, size_t len, uint8_t digest[20]);
+static void m_sha1_block(uint32_t state[5], const uint8_t block[64]);
+
+
+/* -- Implementation ------------------------------------------------------ */
+
+string WebSocket::getAcceptKey(const char * key, size_t keyLen)
+{
+   static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   string input(key, keyLen);
+   uint8_t digest[21] = { 0 }; //padded to a multiple of 3 bytes
+   string accept;
+
+   input += GUID;
+   m_sha1((const uint8_t *)input.data(), input.length(), digest);
+
+   //base64 (20 bytes -> 27 characters + 1 padding character)
+   for (int i = 0; i < 21; i += 3)
+   {
+      const uint32_t triple = ((uint32_t)digest[i] << 16) | ((uint32_t)digest[i + 1] << 8) | digest[i + 2];
+      accept += alphabet[(triple >> 18) & 0x3F];
+      accept += alphabet[(triple >> 12) & 0x3F];
+      accept += alphabet[(triple >> 6) & 0x3F];
+      accept += alphabet[triple & 0x3F];
+   }
+   accept[accept.length() - 1] = '=';
+   return accept;
+}
+
+
+string WebSocket::encodeHeader(uint8_t opcode, size_t length)
+{
+   string header;
+   header += (char)(0x80 | opcode); //FIN
+   if (length < 126)
+   {
+      header += (char)length;
+   }
+   else if (length <= 0xFFFF)
+   {
+      header += (char)126;
+      header += (char)(length >> 8);
+      header += (char)length;
+   }
+   else
+   {
+      header += (char)127;
+      for (int shift = 56; shift >= 0; shift -= 8)
+      {
+         header += (char)((uint64_t)length >> shift);
+      }
+   }
+   return header;
+}
+
+
+uint8_t WebSocket::getDataOpcode(const string& contentType)
+{
+   //text frames must be valid UTF-8 -> only used for textual content types
+   if ((contentType.compare(0, 5, "text/") == 0) ||
+       (contentType.find("json") != string::npos) ||
+       (contentType.find("xml") != string::npos) ||
+       (contentType.find("javascript") != string::npos))
+   {
+      return TEXT;
+   }
+   return BINARY;
+}
+
+
+long WebSocket::decode(uint8_t * data, size_t len, size_t maxPayload, WebSocketFrame& frame)
+{
+   if (len < 2)
+   {
+      return INCOMPLETE;
+   }
+
+   frame.fin = ((data[0] & 0x80) != 0);
+   frame.opcode = data[0] & 0x0F;
+   if ((data[0] & 0x70) != 0) //no extensions negotiated -> reserved bits must not be set
+   {
+      return PROTOCOL_ERROR;
+   }
+   if ((data[1] & 0x80) == 0) //frames sent by clients must be masked
+   {
+      return PROTOCOL_ERROR;
+   }
+   switch (frame.opcode)
+   {
+      case CONTINUATION:
+      case TEXT:
+      case BINARY:
+         break;
+      case CLOSE:
+      case PING:
+      case PONG:
+         if (!frame.fin || ((data[1] & 0x7F) > 125)) //control frames must not be fragmented
+         {
+            return PROTOCOL_ERROR;
+         }
+         break;
+      default:
+         return PROTOCOL_ERROR;
+   }
+
+   //payload length (7 bit, 16 bit or 64 bit)
+   size_t pos = 2;
+   uint64_t length = data[1] & 0x7F;
+   if (length >= 126)
+   {
+      const size_t extended = (length == 126) ? 2 : 8;
+      if (len < (pos + extended))
+      {
+         return INCOMPLETE;
+      }
+      length = 0;
+      for (size_t i = 0; i < extended; ++i)
+      {
+         length = (length << 8) | data[pos++];
+      }
+   }
+   if (length > maxPayload)
+   {
+      return MESSAGE_TOO_LARGE;
+   }
+   if (len < (pos + 4 + length))
+   {
+      return INCOMPLETE;
+   }
+
+   //unmask payload
+   const uint8_t * mask = &data[pos];
+   pos += 4;
+   frame.payload = &data[pos];
+   frame.length = (size_t)length;
+   for (size_t i = 0; i < frame.length; ++i)
+   {
+      frame.payload[i] ^= mask[i & 3];
+   }
+   return (long)(pos + frame.length);
+}
+
+
+//SHA-1 (FIPS 180-4); only used for the opening handshake
+static void m_sha1(const uint8_t * data, size_t len, uint8_t digest[20])
+{
+   uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+   uint8_t block[64];
+   size_t i;
+
+   for (i = 0; (i + 64) <= len; i += 64)
+   {
+      m_sha1_block(state, &data[i]);
+   }
+
+   //padding: 0x80, zeros and the length in bits (big endian)
+   const size_t rest = len - i;
+   memset(block, 0, sizeof(block));
+   memcpy(block, &data[i], rest);
+   block[rest] = 0x80;
+   if (rest >= 56)
+   {
+      m_sha1_block(state, block);
+      memset(block, 0, sizeof(block));
+   }
+   const uint64_t bits = (uint64_t)len * 8;
+   for (int j = 0; j < 8; ++j)
+   {
+      block[63 - j] = (uint8_t)(bits >> (j * 8));
+   }
+   m_sha1_block(state, block);
+
+   for (int j = 0; j < 20; ++j)
+   {
+      digest[j] = (uint8_t)(state[j / 4] >> (24 - ((j % 4) * 8)));
+   }
+}
+
+
+static void m_sha1_block(uint32_t state[5], const uint8_t block[64])
+{
+   uint32_t w[80];
+   uint32_t a = state[0];
+   uint32_t b = state[1];
+   uint32_t c = state[2];
+   uint32_t d = state[3];
+   uint32_t e = state[4];
+
+   for (int i = 0; i < 16; ++i)
+   {
+      w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[(i * 4) + 1] << 16) | ((uint32_t)block[(i * 4) + 2] << 8) | block[(i * 4) + 3];
+   }
+   for (int i = 16; i < 80; ++i)
+   {
+      w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+   }
+
+   for (int i = 0; i < 80; ++i)
+   {
+      uint32_t f;
+      uint32_t k;
+      if (i < 20)
+      {
+         f = (b & c) | (~b & d);
+         k = 0x5A827999;
+      }
+      else if (i < 40)
+      {
+         f = b ^ c ^ d;
+         k = 0x6ED9EBA1;
+      }
+      else if (i < 60)
+      {
+         f = (b & c) | (b & d) | (c & d);
+         k = 0x8F1BBCDC;
+      }
+      else
+      {
+         f = b ^ c ^ d;
+         k = 0xCA62C1D6;
+      }
+      const uint32_t temp = ROL(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = ROL(b, 30);
+      b = a;
+      a = temp;
+   }
+
+   state[0] += a;
+   state[1] += b;
+   state[2] += c;
+   state[3] += d;
+   state[4] += e;
+}
@@ -0,0 +1,84 @@
+//---------------------------------------------------------------------------------------------------------------------
+/*!
+   \file
+   \brief WebSocket (RFC 6455) opening handshake and framing
+*/
+//---------------------------------------------------------------------------------------------------------------------
+#ifndef WEBSOCKET_H_INCLUDED
+#define WEBSOCKET_H_INCLUDED
+
+/* -- Includes ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+
+
+/* -- Defines ------------------------------------------------------------- */
+
+/* -- Types --------------------------------------------------------------- */
+//frame received from a client (payload is unmasked in place; it points into the receive buffer)
+typedef struct
+{
+   bool fin; //final fragment of a message
+   uint8_t opcode;
+   uint8_t * payload;
+   size_t length; //length of payload
+} WebSocketFrame;
+
+
+class WebSocket
+{
+public:
+   //opcodes
+   enum
+   {
+      CONTINUATION = 0x0,
+      TEXT = 0x1,
+      BINARY = 0x2,
+      CLOSE = 0x8,
+      PING = 0x9,
+      PONG = 0xA,
+   };
+
+   //return values of decode()
+   enum
+   {
+      INCOMPLETE = 0, //more data required
+      PROTOCOL_ERROR = -1, //invalid frame (e.g. not masked, reserved bits or opcodes)
+      MESSAGE_TOO_LARGE = -2, //payload exceeds maxPayload
+   };
+
+   //status codes of close frames
+   enum
+   {
+      CLOSE_NORMAL = 1000,
+      CLOSE_GOING_AWAY = 1001,
+      CLOSE_PROTOCOL_ERROR = 1002,
+      CLOSE_TOO_LARGE = 1009,
+   };
+
+   //value of "Sec-WebSocket-Accept" for the given "Sec-WebSocket-Key": base64(SHA-1(key + GUID))
+   static std::string getAcceptKey(const char * key, size_t keyLen);
+
+   //header of an (unfragmented, unmasked) server frame with the given payload length
+   static std::string encodeHeader(uint8_t opcode, size_t length);
+
+   //opcode of data frames carrying content of the given type (TEXT for textual content; BINARY otherwise)
+   static uint8_t getDataOpcode(const std::string& contentType);
+
+   //check if the buffer starts with a complete client frame, and unmask its payload
+   //returns length of the frame; INCOMPLETE, PROTOCOL_ERROR or MESSAGE_TOO_LARGE otherwise
+   static long decode(uint8_t * data, size_t len, size_t maxPayload, WebSocketFrame& frame);
+};
+
+
+/* -- Global Variables ---------------------------------------------------- */
+
+/* -- Function Prototypes ------------------------------------------------- */
+
+/* -- Implementation ------------------------------------------------------ */
+
+
+
+#endif // WEBSOCKET_H_INCLUDED